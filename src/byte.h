@@ -393,6 +393,21 @@ class CLASS_NAME {
          return byte[pos / STORAGE_BITS] & ((STORAGE_TYPE) 1 << (pos % STORAGE_BITS));
        #endif
     }
+    bool test_and_set(const INDEX_TYPE& pos) noexcept { // atomic fetch-or on the word holding the bit
+       #if BIT_LENGTH <= MAX_STORAGE_BITS
+         return __atomic_fetch_or(&byte, (STORAGE_TYPE) 1 << pos, __ATOMIC_RELAXED) & ((STORAGE_TYPE) 1 << pos);
+       #else
+         return __atomic_fetch_or(&byte[pos / STORAGE_BITS], (STORAGE_TYPE) 1 << (pos % STORAGE_BITS), __ATOMIC_RELAXED)
+                & ((STORAGE_TYPE) 1 << (pos % STORAGE_BITS));
+       #endif
+    }
+    constexpr uint_fast8_t octet(const INDEX_TYPE& pos) const noexcept {
+       #if BIT_LENGTH <= MAX_STORAGE_BITS
+         return (byte >> (8 * pos)) & 0xFF;
+       #else
+         return (byte[pos / (STORAGE_BITS / 8)] >> (8 * (pos % (STORAGE_BITS / 8)))) & 0xFF;
+       #endif
+    }
     INDEX_TYPE popcnt() const noexcept {
        #if BIT_LENGTH <= MAX_STORAGE_BITS
          return _popcnt(byte);
@@ -1,4 +1,5 @@
 #include "color.h"
+#include <algorithm>
 
 /*
  * This class contains functions for working with color types.
@@ -59,12 +60,27 @@ void color::complement(color_t& color) {
 bool color::represent(color_t& color) {
     size1N_t count = color.popcnt();
     // return the color set with fewer ones to represent the split
-    if (2*count < n || 2*count == n && (color & 0b1u))
+    if (2*count < n || (2*count == n && (color & 0b1u)))
         return false;    // not inverted
     else color = ~color & mask;    // flip the bits
         return true;    // inverted
 }
 
+/**
+ * This function constructs the representative of a given adaptive color set, in its compact form.
+ *
+ * @param color adaptive color set
+ * @return 1 if inverted, 0 otherwise
+ */
+bool color::represent(color_set& color) {
+    size1N_t count = color.popcnt();
+    // return the color set with fewer ones to represent the split
+    bool inverted = !(2*count < n || (2*count == n && color.test(0)));
+    if (inverted) color.flip();
+    color.compact();
+    return inverted;
+}
+
 /**
  * This function tests if two splits of colors are compatible.
  *
@@ -112,3 +128,162 @@ bool color::is_singleton(const color_t& c){
 	return c.popcnt()==1;
 }
 
+
+/*
+ * [Adaptive color sets]
+ */
+
+color_set::color_set(const color_t& color) {
+    assign(color);
+}
+
+color_set::color_set(const color_set& other) : count(other.count) {
+    if (count == dense) set_bits(new color_t(*other.bits()));
+    else copy(other.ids, other.ids + length(), ids);
+}
+
+color_set::color_set(color_set&& other) noexcept : count(other.count) {
+    if (count == dense) set_bits(other.bits());
+    else copy(other.ids, other.ids + length(), ids);
+    other.count = 0;
+}
+
+color_set& color_set::operator=(color_set other) noexcept {
+    swap(count, other.count);
+    uint16_t tmp[capacity];    // swap the union as raw ids
+    copy(ids, ids + capacity, tmp);
+    copy(other.ids, other.ids + capacity, ids);
+    copy(tmp, tmp + capacity, other.ids);
+    return *this;
+}
+
+color_set::~color_set() {
+    if (count == dense) delete bits();
+}
+
+/**
+ * This function tests if the set contains a color.
+ *
+ * @param pos color
+ * @return true, if contained
+ */
+bool color_set::test(const size1N_t& pos) const {
+    if (count == dense) return bits()->test(pos);
+    bool listed = find(ids, ids + length(), pos) != ids + length();
+    return count & complemented ? !listed && pos < color::n : listed;
+}
+
+/**
+ * This function adds a color to the set (not thread-safe).
+ *
+ * @param pos color
+ */
+void color_set::set(const size1N_t& pos) {
+    if (count == dense) {bits()->set(pos); return;}
+    uint16_t* id = find(ids, ids + length(), pos);
+    if (count & complemented) {    // the color is no longer missing
+        if (id != ids + length()) {*id = ids[length()-1]; count--;}
+        return;
+    }
+    if (id != ids + length()) return;
+    if (count < capacity) {ids[count++] = pos; return;}
+    // too many colors for the list, switch to a bitset
+    color_t* dense_bits = new color_t(0b0u);
+    for (uint16_t i = 0; i < count; ++i) dense_bits->set(ids[i]);
+    dense_bits->set(pos);
+    set_bits(dense_bits);
+    count = dense;
+}
+
+/**
+ * This function adds a color to the set, concurrently with other calls of this function.
+ *
+ * @param pos color
+ * @param added set to true, if the color has been added
+ * @return false, if the set has to be changed by set instead
+ */
+bool color_set::set_shared(const size1N_t& pos, bool& added) {
+    if (count == dense) {added = !bits()->test_and_set(pos); return true;}
+    added = false;
+    return test(pos);
+}
+
+/**
+ * This function returns the number of colors in the set.
+ */
+size1N_t color_set::popcnt() const {
+    if (count == dense) return bits()->popcnt();
+    return count & complemented ? color::n - length() : count;
+}
+
+/**
+ * This function replaces the set by its complement within the color number.
+ */
+void color_set::flip() {
+    if (count == dense) color::complement(*bits());
+    else count ^= complemented;    // the listed ids stay the same
+}
+
+/**
+ * This function converts the set into its smallest (canonical) form, with the inline ids in ascending order.
+ */
+void color_set::compact() {
+    size1N_t ones = popcnt();
+    bool sparse = ones <= capacity, missing = !sparse && color::n - ones <= capacity;
+    if ((sparse && count != dense && !(count & complemented))
+     || (missing && count != dense && (count & complemented))
+     || (!sparse && !missing && count == dense)) {
+        sort(ids, ids + length());    // already in its form
+        return;
+    }
+    color_t color = *this;
+    if (count == dense) delete bits();
+    assign(color);
+}
+
+/**
+ * This function stores a dense bitset in its smallest form, the set must not hold a bitset itself.
+ *
+ * @param color bit sequence
+ */
+void color_set::assign(const color_t& color) {
+    size1N_t ones = color.popcnt();
+    bool sparse = ones <= capacity, missing = !sparse && color::n - ones <= capacity;
+    if (!sparse && !missing) {set_bits(new color_t(color)); count = dense; return;}
+    count = missing ? complemented : 0;
+    uint16_t size = sparse ? ones : color::n - ones;
+    for (size1N_t o = 0; length() < size; ++o) {    // collect the (missing) ids in ascending order, eight colors at a time
+        uint_fast8_t byte = sparse ? color.octet(o) : ~color.octet(o) & 0xFF;
+        for (; byte && length() < size; byte &= byte-1) ids[count++ & ~complemented] = 8*o + __builtin_ctz(byte);
+    }
+}
+
+/**
+ * This function tests if two compact sets are equal.
+ */
+bool color_set::operator==(const color_set& other) const {
+    if (count != other.count) return false;
+    if (count == dense) return *bits() == *other.bits();
+    return equal(ids, ids + length(), other.ids);
+}
+
+/**
+ * This function returns a hash of a compact set.
+ */
+size_t color_set::hash() const {
+    if (count == dense) return std::hash<color_t>()(*bits());
+    uint64_t h = count;
+    for (uint16_t i = 0; i < length(); ++i) h = (h << 16 | h >> 48) ^ ids[i];    // up to seven ids, the table mixes the hash
+    return h;
+}
+
+/**
+ * This function expands the set into a dense bitset.
+ */
+color_set::operator color_t() const {
+    if (count == dense) return *bits();
+    color_t color = 0b0u;
+    for (uint16_t i = 0; i < length(); ++i) color.set(ids[i]);
+    if (count & complemented) color::complement(color);
+    return color;
+}
@@ -1,4 +1,5 @@
 #include <iostream>
+#include <cstring>
 using namespace std;
 
 #ifndef maxN     // max. color number defined
@@ -12,6 +13,8 @@ using namespace std;
 #define SET_ELEMENT_COMPARATORS
 #include "byte.h"
 
+class color_set;
+
 /**
  * This class contains functions for working with color types.
  */
@@ -69,6 +72,14 @@ class color {
      */
     static bool represent(color_t& color);
 
+    /**
+     * This function constructs the representative of a given adaptive color set, in its compact form.
+     *
+     * @param color adaptive color set
+     * @return 1 if inverted, 0 otherwise
+     */
+    static bool represent(color_set& color);
+
     /**
      * This function tests if two splits of colors are compatible.
      *
@@ -108,3 +119,128 @@ class color {
  protected:
 
 };
+
+/**
+ * This class is an adaptive color set for storing the colors of a k-mer or a split with many genomes (large maxN).
+ * Up to a few colors are kept as an inline list of ids, sets lacking only a few colors as an inline list of the missing ids,
+ * and all others as a dense bitset on the heap. Sets only grow while k-mers are read, so these stay sparse or dense;
+ * compact chooses the smallest form, which is the canonical one compared and hashed in the color table.
+ */
+class color_set {
+
+ private:
+
+    /**
+     * This is the number of color ids that fit inline.
+     */
+    static constexpr uint16_t capacity = 7;
+
+    /**
+     * This flags a set stored as the list of its missing colors.
+     */
+    static constexpr uint16_t complemented = 0x8000u;
+
+    /**
+     * This marks a set stored as a dense bitset.
+     */
+    static constexpr uint16_t dense = 0xFFFFu;
+
+    /**
+     * These are the color ids of a sparse set, or the missing ones of a complemented set.
+     * A dense set keeps the pointer to its bitset in their place, so the set takes 16 bytes.
+     */
+    uint16_t ids[capacity];
+
+    /**
+     * This is the number of inline ids (with the complemented flag), or dense.
+     */
+    uint16_t count;
+
+    /**
+     * These functions read and write the pointer to the bitset of a dense set.
+     */
+    color_t* bits() const {color_t* bitset; memcpy(&bitset, ids, sizeof(bitset)); return bitset;}
+    void set_bits(color_t* bitset) {memcpy(ids, &bitset, sizeof(bitset));}
+
+    /**
+     * This function returns the number of inline ids.
+     */
+    uint16_t length() const {return count == dense ? 0 : count & ~complemented;}
+
+    /**
+     * This function stores a dense bitset in its smallest form, the set must not hold a bitset itself.
+     *
+     * @param color bit sequence
+     */
+    void assign(const color_t& color);
+
+ public:
+
+    color_set() noexcept : count(0) {}
+    color_set(const color_t& color);
+    color_set(const color_set& other);
+    color_set(color_set&& other) noexcept;
+    color_set& operator=(color_set other) noexcept;
+    ~color_set();
+
+    /**
+     * This function tests if the set contains a color.
+     *
+     * @param pos color
+     * @return true, if contained
+     */
+    bool test(const size1N_t& pos) const;
+
+    /**
+     * This function adds a color to the set (not thread-safe).
+     *
+     * @param pos color
+     */
+    void set(const size1N_t& pos);
+
+    /**
+     * This function adds a color to the set, concurrently with other calls of this function.
+     * This is only possible if the set is dense or already contains the color.
+     *
+     * @param pos color
+     * @param added set to true, if the color has been added
+     * @return false, if the set has to be changed by set instead
+     */
+    bool set_shared(const size1N_t& pos, bool& added);
+
+    /**
+     * This function returns the number of colors in the set.
+     */
+    size1N_t popcnt() const;
+
+    /**
+     * This function replaces the set by its complement within the color number.
+     */
+    void flip();
+
+    /**
+     * This function converts the set into its smallest (canonical) form, with the inline ids in ascending order.
+     */
+    void compact();
+
+    /**
+     * This function tests if two compact sets are equal.
+     */
+    bool operator==(const color_set& other) const;
+
+    /**
+     * This function returns a hash of a compact set.
+     */
+    size_t hash() const;
+
+    /**
+     * This function expands the set into a dense bitset.
+     */
+    operator color_t() const;
+};
+
+static_assert(sizeof(color_set) == 16, "the adaptive color set should take 16 bytes");
+
+template<> struct std::hash<color_set> {
+    size_t operator()(const color_set& color) const noexcept {return color.hash();}
+};
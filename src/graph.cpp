@@ -1,9 +1,16 @@
 #include "graph.h"
 #include "util.h"
+#include "translator.h"
 #include "pctree/PCTree.h"
 #include <mutex>
 #include <thread>
+#include <condition_variable>
 #include <algorithm>
+#include <fstream>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 /**
  * This is the size of the top list.
@@ -30,27 +37,22 @@ uint64_t graph::table_count;
 /**
  * This is a vecotr of spinlocks protecting the hash maps 
  */
-vector<spinlock> graph::lock;
-
-/**
- * This vector holds the carries of 2**i % table_count for fast distribution of binary represented kmers
- */
-vector<uint_fast32_t> graph::period;
+vector<shared_spinlock> graph::lock;
 
 /**
  * This is vector of hash tables mapping k-mers to colors [O(1)].
  */
-vector<hash_map<kmer_t, color_t>> graph::kmer_table;
+vector<hash_map<kmer_t, kmer_color_t>> graph::kmer_table;
 
 /**
  * This is the amino equivalent.
  */ 
-vector<hash_map<kmerAmino_t, color_t>> graph::kmer_tableAmino;
+vector<hash_map<kmerAmino_t, kmer_color_t>> graph::kmer_tableAmino;
 
 /**
  * This is a hash table mapping colors to weights [O(1)].
  */
-hash_map<color_t, array<uint32_t,2>> graph::color_table;
+hash_map<split_color_t, array<uint32_t,2>> graph::color_table;
 
 /**
  * This is a hash set used to filter k-mers for coverage (q > 1).
@@ -65,8 +67,28 @@ vector<hash_map<kmer_t, uint16_t>> graph::quality_map;
 /**
  * Look-up set for k-mers that are ignored, i.e., not stored, counted etc.
  */
-hash_set<kmer_t> graph::blacklist;
-hash_set<kmerAmino_t> graph::blacklist_amino;
+striped_set<kmer_t> graph::blacklist;
+striped_set<kmerAmino_t> graph::blacklist_amino;
+
+/**
+ * Memory-mapped blacklist index, used instead of the look-up sets if one is given.
+ */
+blacklist_index<kmer_t> graph::blacklist_mapped;
+blacklist_index<kmerAmino_t> graph::blacklist_mappedAmino;
+
+/**
+ * The header of a blacklist index file, followed by the Bloom filter words and the sorted k-mers.
+ */
+struct blacklist_header {
+    char magic[8];    // "SANSBL1"
+    uint64_t k;    // the k-mer length
+    uint64_t amino;    // amino acid k-mers
+    uint64_t reverse;    // canonical k-mers
+    uint64_t width;    // the number of bytes per k-mer
+    uint64_t size;    // the number of k-mers
+    uint64_t words;    // the number of Bloom filter words
+};
+static const char blacklist_magic[8] = "SANSBL2";    // the last character is the format version, 2 with an independent filter seed
 
 
 /**
@@ -94,6 +116,176 @@ vector<hash_set<kmerAmino_t>> graph::quality_setAmino;
  */
 vector<hash_map<kmerAmino_t, uint16_t>> graph::quality_mapAmino;
 
+/**
+ * This indicates that k-mers are counted by sorting buffered (k-mer, color) pairs instead of using the hash tables.
+ */
+bool graph::sorting = false;
+
+/**
+ * This indicates that the coverage threshold is applied while reducing the sorted pairs, all occurrences are buffered (q > 1).
+ */
+bool graph::sort_counting = false;
+
+/**
+ * This is the scaling factor of the FracMinHash sample: only k-mers with a hash of at most max/scaled are kept (1: all).
+ */
+uint64_t graph::scaled = 1;
+
+/**
+ * This is the largest hash of a k-mer in the FracMinHash sample.
+ */
+uint64_t graph::scaled_max = numeric_limits<uint64_t>::max();
+
+/**
+ * This is the length of the s-mers deciding the syncmers (0: all k-mers are kept).
+ */
+uint64_t graph::syncmer_size = 0;
+
+/**
+ * This is the length of the minimizers selecting the bins of the k-mers (0: bins by the hash of the k-mer).
+ */
+uint64_t graph::superkmer_size = 0;
+
+/**
+ * These are the per-thread rolling minimizers of the super-k-mers.
+ */
+vector<smer_window> graph::superkmer_state;
+
+/**
+ * These are the per-thread resolutions of ambiguous (IUPAC) words.
+ */
+vector<iupac_window<false>> graph::iupac_state;
+vector<iupac_window<true>> graph::iupac_stateAmino;
+
+/**
+ * This indicates closed instead of open syncmers.
+ */
+bool graph::syncmer_closed = true;
+
+/**
+ * These are the per-thread rolling s-mer minima deciding the syncmers.
+ */
+vector<smer_window> graph::syncmer_state;
+
+/**
+ * This indicates that the blacklist is used while inserting k-mers.
+ */
+bool graph::blacklisted = false;
+
+/**
+ * This indicates that the k-mers are counted per genome.
+ */
+bool graph::counting = false;
+
+/**
+ * This indicates that each k-mer is forwarded to the tables only once per input file.
+ */
+bool graph::deduplicating = false;
+
+/**
+ * This indicates that the occurrences are estimated by a count-min sketch per thread before a k-mer is kept (q > 1).
+ */
+bool graph::sketching = false;
+uint64_t graph::sketch_width = 1u << 16;
+
+/**
+ * These are the per-thread count-min sketches, reset for each input file.
+ */
+vector<count_sketch<kmer_t>> graph::quality_sketch;
+vector<count_sketch<kmerAmino_t>> graph::quality_sketchAmino;
+
+/**
+ * This indicates that the occurrences are counted per genome across all of its files, by counters shared among the threads (q > 1).
+ */
+bool graph::genome_counting = false;
+
+/**
+ * These are the shared counters of the genomes currently read, allocated by the first and released after the last file of a genome.
+ */
+vector<unique_ptr<genome_counter<kmer_t>>> graph::genome_counts;
+vector<unique_ptr<genome_counter<kmerAmino_t>>> graph::genome_countsAmino;
+
+/**
+ * This is the number of files per genome that have not been read completely yet.
+ */
+vector<uint32_t> graph::genome_files;
+mutex graph::genome_mutex;
+
+/**
+ * These are the per-thread buffers of (k-mer, color) pairs, one for each partition.
+ */
+vector<vector<vector<colored_kmer<kmer_t>>>> graph::kmer_buffer;
+vector<vector<vector<colored_kmer<kmerAmino_t>>>> graph::kmer_bufferAmino;
+
+/**
+ * This is the number of non-singleton k-mers reduced from the sorted buffers.
+ */
+uint64_t graph::sorted_kmer_count = 0;
+
+/**
+ * These are the core k-mers collected while reducing the sorted buffers (if requested).
+ */
+vector<kmer_t> graph::core_kmers;
+vector<kmerAmino_t> graph::core_kmersAmino;
+
+/**
+ * This indicates that the k-mer tables have been frozen into the sorted arrays below.
+ */
+bool graph::frozen = false;
+
+/**
+ * These are the frozen k-mers, sorted within each bin, and the color class of each one.
+ */
+vector<kmer_t> graph::frozen_kmers;
+vector<kmerAmino_t> graph::frozen_kmersAmino;
+vector<uint32_t> graph::frozen_classes;
+
+/**
+ * This is the number of frozen (or consumed) k-mers.
+ */
+uint64_t graph::frozen_count = 0;
+
+/**
+ * This is the start of each bin in the frozen arrays (plus the end of the last bin).
+ */
+vector<uint64_t> graph::frozen_offsets;
+
+/**
+ * These are the distinct color sets of the frozen k-mers (color classes) and their numbers of k-mers.
+ */
+vector<color_t> graph::color_classes;
+vector<uint64_t> graph::class_sizes;
+
+/**
+ * This is the directory the partitions are spilled to when the memory is limited (empty if not).
+ */
+string graph::bucket_dir;
+
+/**
+ * This is the number of partitions the buffered pairs are split into by their bin.
+ */
+uint_fast32_t graph::partition_count = 256;
+
+/**
+ * This is the number of buffered pairs after which a thread spills its buffers to disk (0 if unlimited).
+ */
+uint64_t graph::spill_size = 0;
+
+/**
+ * These are the numbers of pairs currently buffered per thread (strided by a cache line).
+ */
+vector<uint64_t> graph::buffered;
+
+/**
+ * These are the mutexes guarding the appends to the spilled partitions.
+ */
+vector<mutex> graph::bucket_mutex(partition_count);
+
+/**
+ * This is the number of bytes the buffers and the partitions being reduced may use (0 if unlimited).
+ */
+uint64_t graph::memory_budget = 0;
+
 /**
  * This is an ordered tree collecting the splits [O(log n)].
  */
@@ -107,12 +299,14 @@ multimap_<double, color_t> graph::split_list;
 vector<char> graph::allowedChars;
 
 /**
- * This function qualifies a k-mer and places it into the hash table.
+ * These are the sequence processing functions instantiated for the emplace policy of the current run.
  */
-function<void(const uint64_t& T, uint_fast32_t& bin, const kmer_t&, const uint16_t&)> graph::emplace_kmer;
-function<void(const uint64_t& T, uint_fast32_t& bin, const kmer_t&, const uint16_t&)> graph::emplace_kmer_tmp;
-function<void(const uint64_t& T, uint_fast32_t& bin, const kmerAmino_t&, const uint16_t&)> graph::emplace_kmer_amino;
-function<void(const uint64_t& T, uint_fast32_t& bin, const kmerAmino_t&, const uint16_t&)> graph::emplace_kmer_amino_tmp;
+void (*graph::add_kmers_selected)(uint64_t&, string&, uint16_t&, bool&);
+void (*graph::add_minimizers_selected)(uint64_t&, string&, uint16_t&, bool&, uint64_t&);
+void (*graph::add_iupac_kmers_selected)(uint64_t&, string&, uint16_t&, bool&, uint64_t&);
+void (*graph::add_iupac_minimizers_selected)(uint64_t&, string&, uint16_t&, bool&, uint64_t&, uint64_t&);
+void (*graph::add_codons_selected)(uint64_t&, string&, uint16_t&);
+void (*graph::add_frames_selected)(uint64_t&, string&, uint16_t&, bool&);
 
 /**
  * This is a comparison function extending std::bitset.
@@ -152,128 +346,398 @@ struct node* newSet(color_t taxa, double weight, vector<node*> subsets) {
  */
 void graph::activate_blacklist(){
     // Black list for kmers given?
-    if ((!isAmino && !blacklist.empty()) || (isAmino && !blacklist_amino.empty())) {
-		emplace_kmer = [&] (const uint64_t& T, uint_fast32_t& bin, const kmer_t& kmer, const uint16_t& color) {
-			// only add if kmer not in blacklist
-			if (graph::blacklist.find(kmer)==graph::blacklist.end()) {
-				emplace_kmer_tmp(T, bin, kmer, color);
-			}
-		};
-		emplace_kmer_amino = [&] (const uint64_t& T, uint_fast32_t& bin, const kmerAmino_t& kmer, const uint16_t& color) {
-			// only add if kmer not in blacklist
-			if (graph::blacklist_amino.find(kmer)==graph::blacklist_amino.end()) {
-				emplace_kmer_amino_tmp(T, bin, kmer, color);
-			}
-		};
-	}
+    if (size_blacklist() > 0) {
+        blacklisted = true;
+        select_pipeline();
+    }
 }
 
+/**
+ * This function activates forwarding each k-mer only once per input file, the per-thread quality maps keep the k-mers already forwarded.
+ */
+void graph::activate_dedup(uint64_t& thread_count){
+    deduplicating = true;
+    isAmino ? quality_mapAmino.resize(thread_count) : quality_map.resize(thread_count);
+    select_pipeline();
+}
 
 /**
-* --- [Hash map access] ---
-* The following methods are used to access the entries of the vectorized hash maps
-*/ 
+ * This function sets the coverage thresholds and allocates the per-thread tables for the coverage check.
+ *
+ * @param q_table coverage threshold per genome (empty if all are the same)
+ * @param quality global q or maximum among all q values
+ * @param thread_count the number of threads used for processing
+ */
+void graph::set_quality(vector<int>& q_table, int& quality, uint64_t& thread_count){
+    graph::quality = quality;
+    graph::q_table = q_table;
+    switch (quality) {
+    case 1:
+    case 0: /* no quality check */
+        break;
+    case 2:
+        isAmino ? quality_setAmino.resize(thread_count) : quality_set.resize(thread_count);
+        break;
+    default:
+        isAmino ? quality_mapAmino.resize(thread_count) : quality_map.resize(thread_count);
+        break;
+    }
+    select_pipeline();
+}
 
 /**
- * This method shift-updates the bin of a kmer
+ * This function counts the occurrences of the sampled k-mers of a sequence.
+ *
+ * @param str dna sequence
+ * @param counts the occurrences of the sampled k-mers of the genome
+ * @param reverse merge complements
  */
+void graph::sample_kmers(string& str, hash_map<kmer_t, uint8_t>& counts, bool& reverse){
+    kmer_t kmer;    // the current k-mer
+    kmer_t rcmer;    // its reverse complement
+    uint64_t begin = 0;    // the start of the current word
+    for (uint64_t pos = 0; pos < str.length(); ++pos) {
+        if (!isAllowedChar(pos, str)) {
+            begin = pos+1;    // unknown base, start a new k-mer
+            continue;
+        }
+        uint_fast8_t right = util::char_to_bits(str[pos]);
+        kmer::shift(kmer, right);
+        kmer::shift_reverse(rcmer, right);
+        if (pos+1 - begin >= kmer::k) {
+            kmer_t& canonical = reverse && rcmer < kmer ? rcmer : kmer;
+            if (mix_hash<kmer_t, spectrum_seed>()(canonical) % spectrum_sampling != 0) continue;
+            uint8_t& count = counts[canonical];
+            if (count < 255) count++;
+        }
+    }
+}
 
-uint_fast32_t graph::shift_update_bin(uint_fast32_t& bin, uint_fast8_t& left, uint_fast8_t& right)
-{
-        return (8 * table_count // Bias
-            + 4 * (bin - period[2*kmer::k-1] * (left / 2) - (left % 2) * period[2*kmer::k - 2]) // Shift
-            + period[1] * (right / 2) + period[0] * (right % 2)) // Update   
-            % table_count; // Mod
+/**
+ * This function counts the occurrences of the sampled amino k-mers of a sequence.
+ *
+ * @param str amino acid sequence
+ * @param counts the occurrences of the sampled k-mers of the genome
+ */
+void graph::sample_kmers(string& str, hash_map<kmerAmino_t, uint8_t>& counts){
+    kmerAmino_t kmer = 0;    // the current k-mer
+    uint64_t begin = 0;    // the start of the current word
+    for (uint64_t pos = 0; pos < str.length(); ++pos) {
+        if (!isAllowedChar(pos, str)) {
+            begin = pos+1;    // unknown amino acid, start a new k-mer
+            continue;
+        }
+        kmerAmino::shift_right(kmer, str[pos]);
+        if (pos+1 - begin >= kmerAmino::k) {
+            if (mix_hash<kmerAmino_t, spectrum_seed>()(kmer) % spectrum_sampling != 0) continue;
+            uint8_t& count = counts[kmer];
+            if (count < 255) count++;
+        }
+    }
+}
+
+/**
+ * This function chooses a coverage threshold from an abundance spectrum.
+ * The counts fall from the erroneous k-mers (seen once) to the valley, then rise again to the coverage peak.
+ *
+ * @param histogram the abundance spectrum of a genome
+ * @return the coverage threshold
+ */
+int graph::spectrum_threshold(const vector<uint64_t>& histogram){
+    uint64_t valley = 1;    // the first local minimum after the k-mers seen once
+    while (valley+1 < histogram.size() && histogram[valley+1] < histogram[valley]) valley++;
+    if (valley+1 >= histogram.size()) return 1;    // falling to the end
+    uint64_t peak = *max_element(histogram.begin()+valley+1, histogram.end());
+    if (peak < spectrum_peak_factor*histogram[valley] + spectrum_peak_margin) return 1;    // only noise after the valley, no coverage peak
+    return valley;
 }
 
 /**
- * This method shift updates the reverse complement bin of a kmer
+ * This function activates the count-min sketch prefilter for the coverage threshold.
+ *
+ * @param thread_count the number of threads used for processing
+ * @param budget the total memory of the sketches of all threads in bytes
  */
-uint_fast32_t graph::shift_update_rc_bin(uint_fast32_t& rc_bin, uint_fast8_t& left, uint_fast8_t& right)
-{   
-    // Remove
-    rc_bin += 8 * table_count - period[1] * (!(left / 2 )) - period[0] * (!(left % 2 ));
-    // First shift
-    if (rc_bin & 0b1u) {rc_bin += table_count;}
-    rc_bin >>= 1;
-    // Second shift
-    if (rc_bin & 0b1u) {rc_bin += table_count;}
-    rc_bin >>= 1;
-    // Update
-    rc_bin += (period[2*kmer::k-1] * (!(right / 2)) + period[2*kmer::k-2] * (!(right % 2)));
-    rc_bin %= table_count;
-    return rc_bin;
+void graph::activate_sketch(uint64_t& thread_count, const uint64_t& budget){
+    sketching = true;
+    uint64_t row = budget / thread_count / count_sketch<kmer_t>::depth;    // one byte per counter
+    sketch_width = 1u << 16;    // at least 256 KB per thread
+    while (sketch_width < (1u << 28) && 2*sketch_width <= row) sketch_width <<= 1;    // at most 1 GB per thread
+    isAmino ? quality_mapAmino.resize(thread_count) : quality_map.resize(thread_count);
+    isAmino ? quality_sketchAmino.resize(thread_count) : quality_sketch.resize(thread_count);
+    select_pipeline();
 }
 
+/**
+ * This function activates counting the occurrences per genome, the counters of a genome are shared by all threads reading its files.
+ *
+ * @param file_counts the number of input files per genome
+ */
+void graph::activate_genome_counting(const vector<uint32_t>& file_counts){
+    genome_counting = true;
+    genome_files = file_counts;
+    isAmino ? genome_countsAmino.resize(file_counts.size()) : genome_counts.resize(file_counts.size());
+    select_pipeline();
+}
 
 /**
- * This method shift-updates the bin of an amino kmer
+ * This function allocates the shared counters of a genome, unless another thread already reads one of its files.
+ *
+ * @param color the genome
  */
-uint_fast32_t graph::shift_update_amino_bin(uint_fast32_t& bin, kmerAmino_t& kmer, uint_fast8_t& right)
-{
-    // update the binning carry (solution of the shift-update-carry equation)
-    // shift
-    bin = 160 * table_count + // Bias 
-                32 * (bin // Shift
-                - kmer.test(5*kmerAmino::k - 1) * period[5*kmerAmino::k - 1]
-                - kmer.test(5*kmerAmino::k - 2) * period[5*kmerAmino::k - 2]
-                - kmer.test(5*kmerAmino::k - 3) * period[5*kmerAmino::k - 3]
-                - kmer.test(5*kmerAmino::k - 4) * period[5*kmerAmino::k - 4]
-                - kmer.test(5*kmerAmino::k - 5) * period[5*kmerAmino::k - 5]);
-    // update
-    for(int i = 4; i>=0; i--){
-        bin += period[i] * ((right >> i) & 0b1u);
-    }
-    // mod
-    bin %= table_count;
-    return bin;
-}
-
-/**
- * This method computes the bin of a given kmer(slower than shift update)
+void graph::begin_genome_file(const uint16_t& color){
+    std::lock_guard<mutex> lg(genome_mutex);
+    if (isAmino && !genome_countsAmino[color]) genome_countsAmino[color].reset(new genome_counter<kmerAmino_t>());
+    if (!isAmino && !genome_counts[color]) genome_counts[color].reset(new genome_counter<kmer_t>());
+}
+
+/**
+ * This function releases the shared counters of a genome after its last file.
+ *
+ * @param color the genome
+ */
+void graph::end_genome_file(const uint16_t& color){
+    std::lock_guard<mutex> lg(genome_mutex);
+    if (--genome_files[color] > 0) return;
+    isAmino ? genome_countsAmino[color].reset() : genome_counts[color].reset();
+}
+
+/**
+ * This function resets the sketch of a thread for the next input file.
+ *
+ * @param T the thread
+ * @param bytes the (estimated) size of the input file, each row of the sketch has about one counter per base up to the budget
+ */
+void graph::reset_sketch(const uint64_t& T, const uint64_t& bytes){
+    uint64_t width = 1u << 16;    // at least 256 KB
+    while (width < sketch_width && width < bytes/2) width <<= 1;    // a FASTQ file has about one base per two bytes
+    isAmino ? quality_sketchAmino[T].reset(width) : quality_sketch[T].reset(width);
+}
+
+/**
+ * This function selects the emplace policy matching the current settings, each flag is turned into a template argument.
+ */
+void graph::select_pipeline(){
+    auto with = [] (bool flag, auto next) { flag ? next(std::true_type()) : next(std::false_type()); };
+    with(isAmino, [&] (auto amino) {
+    with(blacklisted, [&] (auto filter) {
+    with(counting, [&] (auto count_kmers) {
+        constexpr bool a = decltype(amino)::value, b = decltype(filter)::value, c = decltype(count_kmers)::value;
+        if (genome_counting) with(!q_table.empty(), [&] (auto q_per_genome) {
+            select_pipeline<emplace_policy<a, b, 5, decltype(q_per_genome)::value, c>>();
+        });
+        else if (sketching) with(!q_table.empty(), [&] (auto q_per_genome) {
+            select_pipeline<emplace_policy<a, b, 4, decltype(q_per_genome)::value, c>>();
+        });
+        else if (deduplicating) with(!q_table.empty(), [&] (auto q_per_genome) {
+            select_pipeline<emplace_policy<a, b, 0, decltype(q_per_genome)::value, c>>();
+        });
+        else if (quality <= 1 || sort_counting) {    // no coverage check before buffering
+            select_pipeline<emplace_policy<a, b, 1, false, c>>();
+        } else with(!q_table.empty(), [&] (auto q_per_genome) {
+            constexpr bool g = decltype(q_per_genome)::value;
+            quality == 2 ? select_pipeline<emplace_policy<a, b, 2, g, c>>()
+                         : select_pipeline<emplace_policy<a, b, 3, g, c>>();
+        });
+    });
+    });
+    });
+}
+
+/**
+ * This function installs the sequence processing functions of the given emplace policy.
+ */
+template <typename policy>
+void graph::select_pipeline(){
+    add_kmers_selected = &add_kmers<policy>;
+    add_minimizers_selected = &add_minimizers<policy>;
+    add_iupac_kmers_selected = &add_kmers<policy>;
+    add_iupac_minimizers_selected = &add_minimizers<policy>;
+    add_codons_selected = &add_codons<policy>;
+    add_frames_selected = &add_frames<policy>;
+}
+
+
+/**
+ * This function activates counting k-mers by sorting instead of hashing. The stored k-mers are buffered per thread and partition.
+ *
+ * @param thread_count the number of threads used for processing
+ */
+void graph::activate_sorting(uint64_t& thread_count){
+	sorting = true;
+	if (!isAmino) {
+		kmer_buffer = vector<vector<vector<colored_kmer<kmer_t>>>> (thread_count, vector<vector<colored_kmer<kmer_t>>> (partition_count));
+	} else {
+		kmer_bufferAmino = vector<vector<vector<colored_kmer<kmerAmino_t>>>> (thread_count, vector<vector<colored_kmer<kmerAmino_t>>> (partition_count));
+	}
+}
+
+/**
+ * This function activates keeping only a FracMinHash sample of the k-mers.
+ *
+ * @param s the scaling factor
+ */
+void graph::activate_scaled(const uint64_t& s){
+	scaled = s;
+	scaled_max = numeric_limits<uint64_t>::max() / s;
+}
+
+/**
+ * This function activates keeping only the syncmers among the k-mers.
+ *
+ * @param s the s-mer length
+ * @param closed closed instead of open syncmers
+ * @param reverse merge complements
+ * @param thread_count the number of threads used for processing
+ */
+void graph::activate_syncmers(const uint64_t& s, const bool& closed, const bool& reverse, uint64_t& thread_count){
+	syncmer_size = s;
+	syncmer_closed = closed;
+	syncmer_state.resize(thread_count);
+	for (auto& state : syncmer_state) state.init(s, kmer::k, reverse);
+}
+
+/**
+ * This function activates selecting the bins of the k-mers by their minimizers.
+ *
+ * @param m the minimizer length
+ * @param thread_count the number of threads used for processing
+ */
+void graph::activate_superkmers(const uint64_t& m, uint64_t& thread_count){
+	superkmer_size = m;
+	superkmer_state.resize(thread_count);
+	for (auto& state : superkmer_state) state.init(m, kmer::k, true);    // canonical minimizers, the same on both strands
+}
+
+/**
+ * This function activates resolving the ambiguous (IUPAC) characters of the sequences.
+ *
+ * @param thread_count the number of threads used for processing
+ */
+void graph::activate_iupac(uint64_t& thread_count){
+	if (isAmino) {
+		iupac_stateAmino.resize(thread_count);
+		for (auto& state : iupac_stateAmino) state.init(kmerAmino::k);
+	} else {
+		iupac_state.resize(thread_count);
+		for (auto& state : iupac_state) state.init(kmer::k);
+	}
+}
+
+/**
+ * This method computes the bin of a k-mer from its minimizer, rolling over its bases like add_kmers does.
+ * The window is kept per thread, as this is called for every lookup and for every k-mer on the --window, --iupac and --graph paths.
+ *
  * @param kmer The target kmer
  * @return uint64_t The bin
  */
-#if (maxK <= 32)
-uint_fast32_t graph::compute_bin(const kmer_t& kmer)
-{
-    return kmer % table_count;
-}
-#else
-uint_fast32_t graph::compute_bin(const kmer_t& kmer)
-{
-	uint_fast32_t carry = 1;
-	uint_fast32_t rest = 0;
-	if (kmer.test(0)){rest++;} // Test the last bit
-	for (uint_fast32_t it=1; it < 2 * kmer::k; it++){
-	    carry = (2*carry) % table_count;
-	    if (kmer.test(it)){rest += carry;}
+uint_fast32_t graph::superkmer_bin(const kmer_t& kmer){
+	static thread_local smer_window state;
+	static thread_local vector<uint_fast8_t> bases;
+	if (state.k != kmer::k || state.s != superkmer_size) {
+		state.init(superkmer_size, kmer::k, true);
+		bases.resize(kmer::k);
+	}
+	state.reset();
+	kmer_t copy = kmer;
+	for (uint64_t i = kmer::k; i > 0; --i) {    // the rightmost base is stored in the lowest bits
+		bases[i-1] = (uint64_t) (copy & 0b11u);
+		copy >>= 02u;
 	}
-	return rest % table_count;
+	for (auto& base : bases) state.shift(base);
+	return minimizer_bin(state.min);
 }
-#endif
 
-#if maxK <= 12
-    uint_fast32_t graph::compute_amino_bin(const kmerAmino_t& kmer)
-    {
-        return kmer % table_count;
-    }
-#else
-    uint_fast32_t graph::compute_amino_bin(const kmerAmino_t& kmer)
-    {
-	    uint_fast32_t carry = 1;
-	    uint_fast32_t rest = 0;
+/**
+ * This function applies the coverage threshold while reducing the sorted pairs instead of filtering per thread and file.
+ */
+void graph::activate_sort_counting(){
+	sort_counting = true;
+	select_pipeline();
+}
 
-	    if (kmer.test(0)){rest++;} // Test the last bit
-	    for (uint_fast32_t it=1; it < 5* kmerAmino::k; it--){
-	        carry = (2*carry) % table_count;
-	        if (kmer.test(it)){rest += carry;}
-	    }
-	    return rest % table_count;
-    }
-#endif
+/**
+ * This function limits the memory used for counting by sorting, by spilling the buffered pairs into on-disk partitions.
+ * While reading, the buffers of all threads (including the growth of their vectors) stay within the limit.
+ * While reducing, each thread holds a partition and the temporary array of the radix sort, so there are at least
+ * 2 * threads * pairs / limit partitions (256 at least, up to max_partitions). If these are still too large,
+ * sort_kmers reduces fewer partitions at once.
+ *
+ * @param thread_count the number of threads used for processing
+ * @param max_memory the number of bytes available for the buffers of all threads and for reducing the partitions
+ * @param directory the directory to create the partition files in
+ * @param input_size the (estimated) number of pairs of all input files, an upper bound
+ * @return false if the partition directory could not be created
+ */
+bool graph::activate_external(uint64_t& thread_count, uint64_t max_memory, string directory, uint64_t input_size){
+	const uint_fast32_t max_partitions = 1u << 14;    // not more than bins, each partition is a file
+	uint64_t pair_size = !isAmino ? sizeof(colored_kmer<kmer_t>) : sizeof(colored_kmer<kmerAmino_t>);
+	max_memory = std::max<uint64_t>(max_memory, 1);
+	long double needed = 2.0L * thread_count * input_size * pair_size / max_memory;
+	while (partition_count < needed && partition_count < max_partitions) partition_count <<= 1;
+	bucket_mutex = vector<mutex>(partition_count);
+
+	activate_sorting(thread_count);
+	string path = directory + "/sans_buckets.XXXXXX";
+	vector<char> name(path.begin(), path.end()); name.push_back('\0');
+	if (mkdtemp(name.data()) == nullptr) return false;
+	bucket_dir = name.data();
+	atexit(remove_buckets);    // also on the error exits
+
+	memory_budget = max_memory;
+	spill_size = std::max<uint64_t>(max_memory / pair_size / thread_count / 2, 1);    // a vector may have twice the capacity of its pairs
+	buffered = vector<uint64_t> (8*thread_count, 0);
+	return true;
+}
+
+/**
+ * This function returns the file a partition is spilled to.
+ *
+ * @param p the partition
+ */
+string graph::bucket_path(const uint_fast32_t& p){
+	return bucket_dir + "/" + to_string(p) + ".bin";
+}
+
+/**
+ * This function removes the spilled partitions and their directory, the reduced ones are gone already.
+ */
+void graph::remove_buckets(){
+	if (bucket_dir.empty()) return;
+	for (uint_fast32_t p = 0; p < partition_count; ++p) remove(bucket_path(p).c_str());
+	rmdir(bucket_dir.c_str());
+	bucket_dir.clear();
+}
+
+/**
+ * This function appends the buffered pairs of a thread to the spilled partitions and releases its buffers.
+ *
+ * @param T the thread whose buffers are spilled
+ */
+void graph::spill_buffer(const uint64_t& T){
+	auto spill = [&] (auto& thread_buffer) {
+		for (uint_fast32_t p = 0; p < partition_count; ++p) {
+			auto& pairs = thread_buffer[p];
+			if (pairs.empty()) continue;
+			std::lock_guard<mutex> lg(bucket_mutex[p]);
+			ofstream file(bucket_path(p), ios::binary | ios::app);
+			file.write(reinterpret_cast<const char*>(pairs.data()), pairs.size() * sizeof(pairs[0]));
+			if (!file.good()) {
+				cerr << "Error: could not write k-mers to " << bucket_path(p) << endl;
+				exit(1);
+			}
+			std::decay_t<decltype(pairs)>().swap(pairs);    // release the memory, not only the pairs
+		}
+	};
+	!isAmino ? spill(kmer_buffer[T]) : spill(kmer_bufferAmino[T]);
+	buffered[8*T] = 0;
+}
 
 
+/**
+* --- [Hash map access] ---
+* The following methods are used to access the entries of the vectorized hash maps
+*/ 
 
 /**
  * This function searches the corresponding hash table for the given kmer
@@ -281,6 +745,7 @@ uint_fast32_t graph::compute_bin(const kmer_t& kmer)
  */
 bool graph::search_kmer(const kmer_t& kmer)
 {    
+    if (frozen) return find_frozen(frozen_kmers, compute_bin(kmer), kmer) < frozen_kmers.size();
     return kmer_table[compute_bin(kmer)].contains(kmer);
 }
 
@@ -291,6 +756,7 @@ bool graph::search_kmer(const kmer_t& kmer)
  */
 bool graph::search_kmer_amino(const kmerAmino_t& kmer)
 {
+    if (frozen) return find_frozen(frozen_kmersAmino, compute_amino_bin(kmer), kmer) < frozen_kmersAmino.size();
     return kmer_tableAmino[compute_amino_bin(kmer)].contains(kmer);
 }
 
@@ -301,6 +767,10 @@ bool graph::search_kmer_amino(const kmerAmino_t& kmer)
 * @return color_t The stored colores
 */
 color_t graph::get_color(const kmer_t& kmer, bool reversed){
+    if (frozen) {
+        uint64_t i = find_frozen(frozen_kmers, compute_bin(kmer), kmer);
+        return i < frozen_kmers.size() ? color_classes[frozen_classes[i]] : color_t();
+    }
     return kmer_table[compute_bin(kmer)][kmer];
 }
 
@@ -311,6 +781,10 @@ color_t graph::get_color(const kmer_t& kmer, bool reversed){
  * return color_t The stored color vector
  */
 color_t graph::get_color_amino(const kmerAmino_t& kmer){
+    if (frozen) {
+        uint64_t i = find_frozen(frozen_kmersAmino, compute_amino_bin(kmer), kmer);
+        return i < frozen_kmersAmino.size() ? color_classes[frozen_classes[i]] : color_t();
+    }
     return kmer_tableAmino[compute_amino_bin(kmer)][kmer];
 }
 
@@ -319,6 +793,7 @@ color_t graph::get_color_amino(const kmerAmino_t& kmer){
  * @param kmer The kmer to remove
  */
 void graph::remove_kmer(const kmer_t& kmer, bool reversed){
+    if (frozen) return;    // the tables are released, the frozen arrays are read-only
     kmer_table[compute_bin(kmer)].erase(kmer);
 }
 
@@ -328,9 +803,203 @@ void graph::remove_kmer(const kmer_t& kmer, bool reversed){
  * @param kmer The kmer to remove
  */
 void graph::remove_kmer_amino(const kmerAmino_t& kmer){
+    if (frozen) return;    // the tables are released, the frozen arrays are read-only
     kmer_tableAmino[compute_amino_bin(kmer)].erase(kmer);
 }
 
+/**
+ * This function searches a frozen k-mer in its bin.
+ *
+ * @param kmers the frozen k-mers
+ * @param bin the bin of the k-mer
+ * @param kmer the k-mer to search
+ * @return the index of the k-mer or the size of the frozen arrays if not found
+ */
+template <typename K>
+uint64_t graph::find_frozen(const vector<K>& kmers, const uint_fast32_t& bin, const K& kmer){
+    if (frozen_offsets.empty()) return kmers.size();    // the k-mers have not been kept
+    auto first = kmers.begin() + frozen_offsets[bin], last = kmers.begin() + frozen_offsets[bin+1];
+    auto it = lower_bound(first, last, kmer);
+    return it != last && *it == kmer ? it - kmers.begin() : kmers.size();
+}
+
+/**
+ * This function adds the colors of a range of items (e.g. bins) to the color table in parallel.
+ * Each thread takes chunks of items and adds into its own color tables, one per shard of the colors.
+ * Then each thread merges one shard of all threads, and the merged shards are inserted into the color table (serially).
+ *
+ * @param count the number of items
+ * @param colors_of called as colors_of(i, add) for each item i, calls add(color, n) to add n k-mers of a color
+ * @param thread_count the number of threads used for processing
+ * @param step progress message
+ * @param verbose print progress
+ */
+template <typename F>
+void graph::accumulate_colors(const uint64_t& count, F colors_of, uint64_t& thread_count, const string& step, bool& verbose) {
+    uint64_t shards = thread_count;
+    uint64_t chunk = std::max<uint64_t>(1, count / (64 * thread_count));    // items per request, for load balance
+    vector<vector<hash_map<split_color_t, array<uint32_t,2>>>> local(thread_count, vector<hash_map<split_color_t, array<uint32_t,2>>>(shards));
+
+    uint64_t index = 0, prog = 0, next;
+    std::mutex index_mutex;    // guards the index of the next chunk
+    auto lambda = [&] (uint64_t T) {
+        auto add = [&] (split_color_t color, const uint32_t& n) {
+            bool pos = color::represent(color);    // invert the color set, if necessary
+            if (color.popcnt() == 0) return;    // ignore empty splits
+            local[T][mix_hash<split_color_t>()(color) % shards][color][pos] += n;
+        };
+        while (true) {
+            uint64_t begin;
+            {
+                std::lock_guard<mutex> lg(index_mutex);
+                begin = index; index += chunk;
+                if (verbose && begin < count) {
+                    next = 100*begin/count;
+                    if (prog < next)  cout << "\33[2K\r" << step << next << "%" << flush;
+                    prog = next;
+                }
+            }
+            if (begin >= count) break;
+            for (uint64_t i = begin; i < std::min(begin + chunk, count); ++i) colors_of(i, add);
+        }
+    };
+    vector<thread> thread_holder(thread_count);
+    for (uint64_t thread_id = 0; thread_id < thread_count; ++thread_id){thread_holder[thread_id] = thread(lambda, thread_id);}
+    for (uint64_t thread_id = 0; thread_id < thread_count; ++thread_id){thread_holder[thread_id].join();}
+
+    // merge each shard of all threads into the one of the first thread
+    auto lambda_merge = [&] (uint64_t shard) {
+        hash_map<split_color_t, array<uint32_t,2>>& merged = local[0][shard];
+        for (uint64_t T = 1; T < thread_count; ++T) {
+            for (auto& entry : local[T][shard]) {
+                array<uint32_t,2>& weight = merged[entry.first];
+                weight[0] += entry.second[0];
+                weight[1] += entry.second[1];
+            }
+            hash_map<split_color_t, array<uint32_t,2>>().swap(local[T][shard]);
+        }
+    };
+    for (uint64_t shard = 0; shard < shards; ++shard){thread_holder[shard] = thread(lambda_merge, shard);}
+    for (uint64_t shard = 0; shard < shards; ++shard){thread_holder[shard].join();}
+
+    // the shards are disjoint, only new colors are inserted here (unless the color table was filled before);
+    // this stays serial, as the ties of the split list and the draws of the bootstrap follow the iteration order
+    // of a single color table, and inserting the distinct colors is cheap next to accumulating the k-mers
+    uint64_t size = color_table.size();
+    for (auto& shard : local[0]) size += shard.size();
+    color_table.reserve(size);
+    for (auto& shard : local[0]) {
+        for (auto& entry : shard) {
+            array<uint32_t,2>& weight = color_table[entry.first];
+            weight[0] += entry.second[0];
+            weight[1] += entry.second[1];
+        }
+        hash_map<split_color_t, array<uint32_t,2>>().swap(shard);
+    }
+}
+
+/**
+ * This function freezes the k-mer tables after reading: each bin is moved into sorted arrays of k-mers
+ * and color class ids, and released. The tables must not be modified afterwards.
+ * Without keeping the k-mers, each bin is consumed into the color table right away instead (in parallel).
+ * @param keep_kmers keep the k-mers in the frozen arrays
+ * @param thread_count the number of threads used for consuming the bins
+ * @param verbose print progess
+ */
+void graph::freeze_tables(bool keep_kmers, uint64_t& thread_count, bool& verbose){
+    if (frozen) return;
+    !isAmino ? freeze(kmer_table, frozen_kmers, keep_kmers, thread_count, verbose) : freeze(kmer_tableAmino, frozen_kmersAmino, keep_kmers, thread_count, verbose);
+    // the singletons are only needed as counts from now on
+    vector<hash_map<kmer_t, uint16_t>>().swap(singleton_kmer_table);
+    vector<hash_map<kmerAmino_t, uint16_t>>().swap(singleton_kmer_tableAmino);
+    frozen = true;
+}
+
+/**
+ * This function moves the bins of a k-mer table into the frozen arrays.
+ *
+ * @param table the k-mer table (released)
+ * @param kmers the frozen k-mers
+ * @param keep_kmers keep the k-mers, else their colors are added to the color table
+ * @param thread_count the number of threads used for consuming the bins
+ * @param verbose print progess
+ */
+template <typename K>
+void graph::freeze(vector<hash_map<K, kmer_color_t>>& table, vector<K>& kmers, bool keep_kmers, uint64_t& thread_count, bool& verbose){
+    uint64_t size = 0, prog = 0, next;
+    for (auto& bin : table) size += bin.size();
+    frozen_count = size;
+
+    if (!keep_kmers) {
+        // add the colors to the color table as add_weights would do, each bin is released by the thread consuming it
+        accumulate_colors(table.size(), [&] (const uint64_t& i, auto& add) {
+            for (auto it = table[i].begin(); it != table[i].end(); ++it) add(it.value(), 1);
+            hash_map<K, kmer_color_t>().swap(table[i]);
+        }, thread_count, "Consuming k-mer tables... ", verbose);
+        vector<hash_map<K, kmer_color_t>>().swap(table);
+        return;
+    }
+    frozen_offsets.assign(table_count+1, 0);
+
+    hash_map<color_t, uint32_t> class_ids;    // the id of each color class
+    vector<pair<K, uint32_t>> entries;    // the k-mers of a bin with their class id, to be sorted
+
+    for (uint64_t i = 0; i < table.size(); ++i) {
+        if (verbose) {
+            next = 100*i/table.size();
+            if (prog < next)  cout << "\33[2K\r" << "Freezing k-mer tables... " << next << "%" << flush;
+            prog = next;
+        }
+        entries.clear();
+        for (auto it = table[i].begin(); it != table[i].end(); ++it) {
+            color_t color = it.value();
+            auto id = class_ids.emplace(color, color_classes.size());
+            if (id.second) {    // a new color class
+                color_classes.push_back(color);
+                class_sizes.push_back(0);
+            }
+            class_sizes[id.first->second]++;
+            entries.emplace_back(it.key(), id.first->second);
+        }
+        hash_map<K, kmer_color_t>().swap(table[i]);    // release the bin, before the arrays grow by it
+
+        sort(entries.begin(), entries.end(), [] (const pair<K, uint32_t>& a, const pair<K, uint32_t>& b) {return a.first < b.first;});
+        for (auto& entry : entries) {
+            kmers.push_back(entry.first);
+            frozen_classes.push_back(entry.second);
+        }
+        frozen_offsets[i+1] = kmers.size();
+    }
+    vector<hash_map<K, kmer_color_t>>().swap(table);
+    // drop the slack of the growth, now that no table is held anymore
+    kmers.shrink_to_fit();
+    frozen_classes.shrink_to_fit();
+}
+
+/**
+ * This function reports the distribution of k-mers (including singletons) over the bins.
+ * A maximum close to the mean indicates balanced tables and little lock contention.
+ * @param out output stream
+ */
+void graph::print_bin_statistics(ostream& out) {
+    if (sorting || frozen) return;    // the tables are not used (anymore)
+    vector<uint64_t> sizes(table_count);
+    for (uint64_t i = 0; i < table_count; ++i) {
+        sizes[i] = !isAmino ? kmer_table[i].size() + singleton_kmer_table[i].size()
+                            : kmer_tableAmino[i].size() + singleton_kmer_tableAmino[i].size();
+    }
+    double mu = util::mean(sizes.data(), table_count);
+    double sigma = util::stdev(sizes.data(), mu, table_count);
+    sort(sizes.begin(), sizes.end());
+
+    out << "Bin sizes: min. " << sizes.front() << ", median " << sizes[table_count/2] << ", max. " << sizes.back()
+        << ", mean " << static_cast<int>(std::round(mu)) << ", standard deviation " << static_cast<int>(std::round(sigma));
+    if (mu > 0) {
+        out << " (max. load " << static_cast<int>(std::round(100*sizes.back()/mu)) << "% of mean)";
+    }
+    out << endl;
+}
+
 /*
 *
 * [Sequence processing]
@@ -340,6 +1009,7 @@ void graph::remove_kmer_amino(const kmerAmino_t& kmer){
 
 /**
  * This function extracts k-mers from a sequence and adds them to the black list.
+ * The black list is striped over locked sets, so several threads can add sequences at once.
  *
  * @param str sequence
  * @param reverse merge complements
@@ -352,8 +1022,6 @@ void graph::fill_blacklist(string& str, bool& reverse) {
     kmer_t kmer;    // create a new empty bit sequence for the k-mer
     kmer_t rcmer; // create a bit sequence for the reverse complement
 
-
-    uint_fast8_t left;  // The character that is shifted out 
     uint_fast8_t right; // The binary code of the character that is shifted in
 
     kmerAmino_t kmerAmino=0;    // create a new empty bit sequence for the k-mer
@@ -372,48 +1040,177 @@ void graph::fill_blacklist(string& str, bool& reverse) {
         if (!isAmino) {
 
             right = util::char_to_bits(str[pos]);
-            #if maxK <= 32
-                kmer::shift(kmer, right); // shift each base into the bit sequence
-                rcmer = kmer;
-	            if (reverse){
-                    kmer::reverse_complement(rcmer); // invert the k-mer
-                }
-            #else
-                kmer::shift(kmer, right); // shift each base into the bit sequence
-                rcmer = kmer;
-                if (reverse){
-                    kmer::reverse_complement(rcmer);
-                }
-            #endif
+            kmer::shift(kmer, right); // shift each base into the bit sequence
+            kmer::shift_reverse(rcmer, right); // shift its complement into the reverse complement
              // If the current word is a k-mer
             if (pos+1 - begin >= kmer::k) {
-                rcmer < kmer ? blacklist.emplace(rcmer) : blacklist.emplace(kmer);
+                reverse && rcmer < kmer ? blacklist.add(rcmer) : blacklist.add(kmer);
             }
         
         // Amino processing
         } else {
-            #if maxK <= 12
-                kmerAmino::shift_right(kmerAmino, str[pos]);    // shift each base into the bit sequence
-            #else
-                kmerAmino::shift_right(kmerAmino, str[pos]);
-            #endif
+            kmerAmino::shift_right(kmerAmino, str[pos]);    // shift each base into the bit sequence
             // The current word is a k-mer
             if (pos+1 - begin >= kmerAmino::k) {
                 // Insert the k-mer
-                blacklist_amino.emplace(kmerAmino);
+                blacklist_amino.add(kmerAmino);
             }
         }
     }
 }
 
 
-/**
-* This function tells how many k-mers are in the black list.
-*/
-uint64_t graph::size_blacklist(){
-	return isAmino ? blacklist_amino.size() : blacklist.size();
+/**
+* This function tells how many k-mers are in the black list.
+*/
+uint64_t graph::size_blacklist(){
+	if (isAmino) return blacklist_mappedAmino.bloom ? blacklist_mappedAmino.size : blacklist_amino.size();
+	return blacklist_mapped.bloom ? blacklist_mapped.size : blacklist.size();
+}
+
+
+/**
+ * This function writes the k-mers of the striped look-up set into an index file: the header, a Bloom filter of about ten bits per k-mer, and the sorted k-mers.
+ */
+template <typename K>
+static bool write_blacklist(const string& path, const striped_set<K>& set, bool amino, uint64_t k, bool reverse) {
+    vector<K> kmers;
+    kmers.reserve(set.size());
+    for (auto& stripe : set.stripe) kmers.insert(kmers.end(), stripe.begin(), stripe.end());
+    sort(kmers.begin(), kmers.end());
+
+    uint64_t bits = 128;    // a power of two, so positions are masked, and at least two words, so the k-mers stay aligned
+    while (bits < 10 * kmers.size()) bits <<= 1;
+    blacklist_index<K> index;
+    index.mask = bits - 1;
+    vector<uint64_t> bloom(bits / 64);
+    for (auto& kmer : kmers) index.insert(bloom, kmer);
+
+    blacklist_header header = {{}, k, amino, reverse, sizeof(K), kmers.size(), bloom.size()};
+    copy(blacklist_magic, blacklist_magic + 8, header.magic);
+
+    ofstream file(path, ios::binary);
+    file.write((const char*) &header, sizeof(header));
+    file.write((const char*) bloom.data(), bloom.size() * sizeof(uint64_t));
+    file.write((const char*) kmers.data(), kmers.size() * sizeof(K));
+    return file.good();
+}
+
+/**
+ * This function writes the blacklist into an index file that later runs memory-map instead of reading the k-mers again.
+ *
+ * @param path index file
+ * @param reverse merge complements
+ * @return true, if the file was written
+ */
+bool graph::save_blacklist(const string& path, bool& reverse) {
+    return isAmino ? write_blacklist(path, blacklist_amino, true, kmerAmino::k, false)
+                   : write_blacklist(path, blacklist, false, kmer::k, reverse);
+}
+
+
+/**
+ * This function tells if a file is a blacklist index rather than a sequence file.
+ *
+ * @param path blacklist file
+ * @return true, if the file starts with the index header (of any version)
+ */
+bool graph::is_blacklist_index(const string& path) {
+    ifstream file(path, ios::binary);
+    char magic[8] = {};
+    file.read(magic, 8);
+    return file.good() && equal(magic, magic + 6, blacklist_magic);
+}
+
+
+/**
+ * This function memory-maps a blacklist index. The mapping is read-only and shared, so concurrent runs keep only one copy in memory.
+ *
+ * @param path index file
+ * @param reverse merge complements
+ * @return true, if the index was mapped and fits the k-mer length, alphabet, and orientation of this run
+ */
+bool graph::load_blacklist(const string& path, bool& reverse) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        cerr << "Error: could not open blacklist index " << path << endl;
+        return false;
+    }
+    struct stat status;
+    if (fstat(fd, &status) != 0) {
+        cerr << "Error: could not read the size of blacklist index " << path << endl;
+        close(fd);
+        return false;
+    }
+    uint64_t length = status.st_size;
+    void* map = length >= sizeof(blacklist_header) ? mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+    close(fd);    // the mapping stays valid
+    if (map == MAP_FAILED) {
+        cerr << "Error: could not map blacklist index " << path << endl;
+        return false;
+    }
+
+    const blacklist_header* header = (const blacklist_header*) map;
+    uint64_t width = isAmino ? sizeof(kmerAmino_t) : sizeof(kmer_t);
+    if (!equal(header->magic, header->magic + 6, blacklist_magic)) {
+        cerr << "Error: " << path << " is not a blacklist index" << endl;
+        munmap(map, length);
+        return false;
+    }
+    if (!equal(header->magic, header->magic + 8, blacklist_magic)) {
+        cerr << "Error: blacklist index " << path << " has an outdated format, build it again with --blacklist-index" << endl;
+        munmap(map, length);
+        return false;
+    }
+    if (header->amino != isAmino || header->k != (isAmino ? kmerAmino::k : kmer::k) || (!isAmino && header->reverse != reverse)) {
+        cerr << "Error: blacklist index " << path << " was built for " << (header->amino ? "amino acid" : "nucleotide") << " k-mers with k = " << header->k
+             << (header->amino ? "" : header->reverse ? " and reverse complements" : " and --norev") << ", which does not match this run" << endl;
+        munmap(map, length);
+        return false;
+    }
+    if (header->width != width || length != sizeof(blacklist_header) + header->words * sizeof(uint64_t) + header->size * width) {
+        cerr << "Error: blacklist index " << path << " is truncated or was built with another -DmaxK" << endl;
+        munmap(map, length);
+        return false;
+    }
+
+    const uint64_t* bloom = (const uint64_t*) (header + 1);
+    if (isAmino) {
+        blacklist_mappedAmino = {bloom, header->words * 64 - 1, (const kmerAmino_t*) (bloom + header->words), header->size};
+    } else {
+        blacklist_mapped = {bloom, header->words * 64 - 1, (const kmer_t*) (bloom + header->words), header->size};
+    }
+    return true;
+}
+
+
+/**
+ * These functions extract (minimizer) k-mers from a sequence and add them to the hash table,
+ * using the functions instantiated for the selected emplace policy.
+ */
+void graph::add_kmers(uint64_t& T, string& str, uint16_t& color, bool& reverse) {
+    add_kmers_selected(T, str, color, reverse);
+}
+
+void graph::add_minimizers(uint64_t& T, string& str, uint16_t& color, bool& reverse, uint64_t& m) {
+    add_minimizers_selected(T, str, color, reverse, m);
+}
+
+void graph::add_kmers(uint64_t& T, string& str, uint16_t& color, bool& reverse, uint64_t& max_iupac) {
+    add_iupac_kmers_selected(T, str, color, reverse, max_iupac);
+}
+
+void graph::add_minimizers(uint64_t& T, string& str, uint16_t& color, bool& reverse, uint64_t& m, uint64_t& max_iupac) {
+    add_iupac_minimizers_selected(T, str, color, reverse, m, max_iupac);
 }
 
+void graph::add_codons(uint64_t& T, string& str, uint16_t& color) {
+    add_codons_selected(T, str, color);
+}
+
+void graph::add_frames(uint64_t& T, string& str, uint16_t& color, bool& stops) {
+    add_frames_selected(T, str, color, stops);
+}
 
 /**
  * This function extracts k-mers from a sequence and adds them to the hash table.
@@ -422,166 +1219,290 @@ uint64_t graph::size_blacklist(){
  * @param color color flag
  * @param reverse merge complements
  */
+template <typename policy>
 void graph::add_kmers(uint64_t& T, string& str, uint16_t& color, bool& reverse) {
     if (str.length() < kmer::k) return;    // not enough characters
 
-    uint_fast32_t bin = 0; // current hash_map vector index
-    uint_fast32_t rc_bin = 0; // current reverse hash_map vector index
-
     uint64_t pos;    // current position in the string, from 0 to length
 
     kmer_t kmer;    // create a new empty bit sequence for the k-mer
     kmer_t rcmer; // create a bit sequence for the reverse complement
 
-
-    uint_fast8_t left;  // The character that is shifted out 
     uint_fast8_t right; // The binary code of the character that is shifted in
 
-    #if maxK > 32
-    if (!isAmino){
-        for (int i =0; i < 2* kmer::k; i++){rc_bin += period[i];}
-        rc_bin %= table_count;
-    }
-    #endif
-
     kmerAmino_t kmerAmino=0;    // create a new empty bit sequence for the k-mer
 
+    kmer_t ahead_kmer[lookahead];    // k-mers whose bins are prefetched, waiting for insertion
+    kmerAmino_t ahead_kmerAmino[lookahead];
+    uint_fast32_t ahead_bin[lookahead];    // the bins of the waiting k-mers
+    uint_fast32_t ahead_pos = 0;    // the oldest waiting k-mer (once the buffer is full)
+    uint_fast32_t ahead_size = 0;    // the number of waiting k-mers
+
+    bool syncmers = !policy::amino && syncmer_size > 0;    // keep only the syncmers
+    bool syncmer = false;    // the current k-mer is a syncmer
+
+    bool superkmers = !policy::amino && superkmer_size > 0;    // bins by minimizer, runs of k-mers are inserted together
+    kmer_t run_kmer[run_capacity];    // the current run of k-mers of the same bin
+    uint_fast32_t run_bin = 0, run_size = 0;
+
     uint64_t begin = 0;
     
     next_kmer:
 
     pos = begin;
+    if (syncmers) syncmer_state[T].reset();
+    if (superkmers) superkmer_state[T].reset();
     for (; pos < str.length(); ++pos) {    // collect the bases from the string
         if (!isAllowedChar(pos, str)) {
             begin = pos+1;    // str = str.substr(pos+1, string::npos);
             goto next_kmer;    // unknown base, start a new k-mer from the beginning
         }
         // DNA processing 
-        if (!isAmino) {
+        if (!policy::amino) {
             right = util::char_to_bits(str[pos]);
-            #if maxK <= 32
-                kmer::shift(kmer, right); // shift each base into the bit sequence
-                rcmer = kmer;
-
-                bin = kmer % table_count; // update the forward bin
-	            if (reverse){
-                    kmer::reverse_complement(rcmer); // invert the k-mer
-                    rc_bin = rcmer % table_count;
-                }
-            #else
-                left = 2*kmer.test(2*kmer::k-1)+kmer.test(2*kmer::k-2); // old leftmost character
-                bin = shift_update_bin(bin, left, right); // Shift update the forward complement bin
-                
-                kmer::shift(kmer, right); // shift each base into the bit sequence
-                rcmer = kmer;
-                if (reverse){
-                    kmer::reverse_complement(rcmer);
-                    rc_bin = shift_update_rc_bin(rc_bin, left, right);  // Update the reverse complement table index
-                }
-            #endif
+            kmer::shift(kmer, right); // shift each base into the bit sequence
+            kmer::shift_reverse(rcmer, right); // shift its complement into the reverse complement
+            if (syncmers) syncmer = syncmer_state[T].shift(right) && (syncmer_closed ? syncmer_state[T].closed_syncmer() : syncmer_state[T].open_syncmer());
+            if (superkmers) superkmer_state[T].shift(right);
              // If the current word is a k-mer
             if (pos+1 - begin >= kmer::k) {
-                rcmer < kmer ? emplace_kmer(T, rc_bin, rcmer, color) : emplace_kmer(T, bin, kmer, color);
+                if (syncmers && !syncmer) continue;    // not a syncmer
+                kmer_t& canonical = reverse && rcmer < kmer ? rcmer : kmer;
+                if (scaled > 1 && !in_sample(canonical)) continue;    // not in the FracMinHash sample
+                if (superkmers) {
+                    // extend the run while the minimizer keeps the bin, otherwise insert it and start a new one
+                    uint_fast32_t bin = minimizer_bin(superkmer_state[T].min);
+                    if (run_size == run_capacity || (run_size > 0 && bin != run_bin)) {
+                        emplace_run<policy>(T, run_bin, run_kmer, run_size, color);
+                        run_size = 0;
+                    }
+                    run_bin = bin;
+                    run_kmer[run_size++] = canonical;
+                    continue;
+                }
+                // insert the oldest waiting k-mer, its bin and buckets have been prefetched by now
+                if (ahead_size == lookahead) emplace_kmer<policy>(T, ahead_bin[ahead_pos], ahead_kmer[ahead_pos], color);
+                else ahead_size++;
+                // prefetch the bin of the current (canonical) k-mer and let it wait
+                ahead_kmer[ahead_pos] = canonical;
+                ahead_bin[ahead_pos] = compute_bin(ahead_kmer[ahead_pos]);
+                prefetch_bin(ahead_bin[ahead_pos]);
+                // prefetch the buckets of the k-mer halfway through, its bin has arrived by now
+                uint_fast32_t half = (ahead_pos + lookahead/2) % lookahead;
+                if (ahead_size > lookahead/2) prefetch_buckets(ahead_bin[half], ahead_kmer[half]);
+                ahead_pos = (ahead_pos+1) % lookahead;
             }
         
         // Amino processing
         } else {
-            right = util::amino_char_to_bits(str[pos]);
-            #if maxK <= 12
-                kmerAmino::shift_right(kmerAmino, str[pos]);    // shift each base into the bit sequence
-                bin = kmerAmino % table_count;
-            #else
-                bin = shift_update_amino_bin(bin, kmerAmino, right);
-                kmerAmino::shift_right(kmerAmino, str[pos]);
-            #endif
+            kmerAmino::shift_right(kmerAmino, str[pos]);    // shift each base into the bit sequence
             // The current word is a k-mer
             if (pos+1 - begin >= kmerAmino::k) {
-                // shift update the bin
-                // Insert the k-mer into its table
-                emplace_kmer_amino(T, bin, kmerAmino, color);  // update the k-mer with the current color
+                if (scaled > 1 && !in_sample(kmerAmino)) continue;    // not in the FracMinHash sample
+                // insert the oldest waiting k-mer, its bin and buckets have been prefetched by now
+                if (ahead_size == lookahead) emplace_kmer_amino<policy>(T, ahead_bin[ahead_pos], ahead_kmerAmino[ahead_pos], color);
+                else ahead_size++;
+                // prefetch the bin of the current k-mer and let it wait
+                ahead_kmerAmino[ahead_pos] = kmerAmino;
+                ahead_bin[ahead_pos] = compute_amino_bin(kmerAmino);
+                prefetch_amino_bin(ahead_bin[ahead_pos]);
+                uint_fast32_t half = (ahead_pos + lookahead/2) % lookahead;
+                if (ahead_size > lookahead/2) prefetch_amino_buckets(ahead_bin[half], ahead_kmerAmino[half]);
+                ahead_pos = (ahead_pos+1) % lookahead;
+            }
+        }
+    }
+
+    if (run_size > 0) emplace_run<policy>(T, run_bin, run_kmer, run_size, color);
+
+    // insert the remaining waiting k-mers in their original order
+    ahead_pos = (ahead_pos + lookahead - ahead_size) % lookahead;
+    for (; ahead_size > 0; --ahead_size, ahead_pos = (ahead_pos+1) % lookahead) {
+        !policy::amino ? emplace_kmer<policy>(T, ahead_bin[ahead_pos], ahead_kmer[ahead_pos], color)
+                 : emplace_kmer_amino<policy>(T, ahead_bin[ahead_pos], ahead_kmerAmino[ahead_pos], color);
+    }
+}
+
+/**
+ * This function translates a coding sequence and adds its amino acid k-mers to the hash table.
+ *
+ * @param str dna sequence (in frame)
+ * @param color color flag
+ */
+template <typename policy>
+void graph::add_codons(uint64_t& T, string& str, uint16_t& color) {
+    if (str.length() < 3*kmerAmino::k) return;    // not enough codons
+
+    kmerAmino_t kmerAmino = 0;    // create a new empty bit sequence for the k-mer
+    uint8_t right;    // the binary code of the amino acid that is shifted in
+    uint64_t length = 0;    // the number of amino acids in the current word
+
+    kmerAmino_t ahead_kmerAmino[lookahead];    // k-mers whose bins are prefetched, waiting for insertion
+    uint_fast32_t ahead_bin[lookahead];    // the bins of the waiting k-mers
+    uint_fast32_t ahead_pos = 0;    // the oldest waiting k-mer (once the buffer is full)
+    uint_fast32_t ahead_size = 0;    // the number of waiting k-mers
+
+    for (uint64_t pos = 0; pos+3 <= str.length(); pos += 3) {    // translate the codons of the string
+        right = translator::aminoCode(translator::codonKey(&str[pos]));
+        if (right == translator::untranslated) {
+            count::incrementCount();
+            length = 0;    // unknown amino acid, start a new k-mer from the beginning
+            continue;
+        }
+        kmerAmino::shift_right(kmerAmino, right);    // shift each amino acid into the bit sequence
+        // The current word is a k-mer
+        if (++length >= kmerAmino::k) {
+            if (scaled > 1 && !in_sample(kmerAmino)) continue;    // not in the FracMinHash sample
+            // insert the oldest waiting k-mer, its bin and buckets have been prefetched by now
+            if (ahead_size == lookahead) emplace_kmer_amino<policy>(T, ahead_bin[ahead_pos], ahead_kmerAmino[ahead_pos], color);
+            else ahead_size++;
+            // prefetch the bin of the current k-mer and let it wait
+            ahead_kmerAmino[ahead_pos] = kmerAmino;
+            ahead_bin[ahead_pos] = compute_amino_bin(kmerAmino);
+            prefetch_amino_bin(ahead_bin[ahead_pos]);
+            uint_fast32_t half = (ahead_pos + lookahead/2) % lookahead;
+            if (ahead_size > lookahead/2) prefetch_amino_buckets(ahead_bin[half], ahead_kmerAmino[half]);
+            ahead_pos = (ahead_pos+1) % lookahead;
+        }
+    }
+
+    // insert the remaining waiting k-mers in their original order
+    ahead_pos = (ahead_pos + lookahead - ahead_size) % lookahead;
+    for (; ahead_size > 0; --ahead_size, ahead_pos = (ahead_pos+1) % lookahead) {
+        emplace_kmer_amino<policy>(T, ahead_bin[ahead_pos], ahead_kmerAmino[ahead_pos], color);
+    }
+}
+
+/**
+ * This function translates a sequence in all six reading frames and adds their amino acid k-mers to the hash table.
+ *
+ * @param str dna sequence
+ * @param color color flag
+ * @param stops break the k-mers at stop codons
+ */
+template <typename policy>
+void graph::add_frames(uint64_t& T, string& str, uint16_t& color, bool& stops) {
+    if (str.length() < 3*kmerAmino::k) return;    // not enough codons
+
+    uint16_t codon = 0, rccodon = 0;    // the masks of the last three bases and of their reverse complement
+    uint8_t mask, right;
+    kmerAmino_t kmerAmino[6] = {0, 0, 0, 0, 0, 0};    // the k-mers of the three forward and the three reverse frames
+    uint64_t length[6] = {0, 0, 0, 0, 0, 0};    // the number of amino acids in the current word of each frame
+
+    kmerAmino_t ahead_kmerAmino[lookahead];    // k-mers whose bins are prefetched, waiting for insertion
+    uint_fast32_t ahead_bin[lookahead];    // the bins of the waiting k-mers
+    uint_fast32_t ahead_pos = 0;    // the oldest waiting k-mer (once the buffer is full)
+    uint_fast32_t ahead_size = 0;    // the number of waiting k-mers
+
+    for (uint64_t pos = 0; pos < str.length(); ++pos) {    // shift the bases into the codons of both strands
+        mask = translator::baseMask(str[pos]);
+        codon = (codon << 4 | mask) & 0xFFFu;
+        rccodon = rccodon >> 4 | translator::complementMask(mask) << 8;
+        if (pos < 2) continue;    // no complete codon yet
+
+        for (uint64_t f = pos % 3; f < 6; f += 3) {    // the forward and the reverse frame ending here
+            right = translator::aminoCode(f < 3 ? codon : rccodon);
+            if (right == translator::untranslated || (stops && right == translator::stopCode)) {
+                if (right == translator::untranslated) count::incrementCount();
+                length[f] = 0;    // start a new k-mer from the beginning
+                continue;
+            }
+            // the forward frames append amino acids to the right, the reverse frames to the left
+            f < 3 ? kmerAmino::shift_right(kmerAmino[f], right) : kmerAmino::shift_left(kmerAmino[f], right);
+            // The current word is a k-mer
+            if (++length[f] >= kmerAmino::k) {
+                if (scaled > 1 && !in_sample(kmerAmino[f])) continue;    // not in the FracMinHash sample
+                // insert the oldest waiting k-mer, its bin and buckets have been prefetched by now
+                if (ahead_size == lookahead) emplace_kmer_amino<policy>(T, ahead_bin[ahead_pos], ahead_kmerAmino[ahead_pos], color);
+                else ahead_size++;
+                // prefetch the bin of the current k-mer and let it wait
+                ahead_kmerAmino[ahead_pos] = kmerAmino[f];
+                ahead_bin[ahead_pos] = compute_amino_bin(kmerAmino[f]);
+                prefetch_amino_bin(ahead_bin[ahead_pos]);
+                uint_fast32_t half = (ahead_pos + lookahead/2) % lookahead;
+                if (ahead_size > lookahead/2) prefetch_amino_buckets(ahead_bin[half], ahead_kmerAmino[half]);
+                ahead_pos = (ahead_pos+1) % lookahead;
             }
         }
     }
-    
 
+    // insert the remaining waiting k-mers in their original order
+    ahead_pos = (ahead_pos + lookahead - ahead_size) % lookahead;
+    for (; ahead_size > 0; --ahead_size, ahead_pos = (ahead_pos+1) % lookahead) {
+        emplace_kmer_amino<policy>(T, ahead_bin[ahead_pos], ahead_kmerAmino[ahead_pos], color);
+    }
 }
 
 /**
  * This function extracts k-mer minimizers from a sequence and adds them to the hash table.
+ * The window minimum over the hashed (canonical) k-mers is maintained by a monotone queue in O(1) per position,
+ * each minimizer is added once per occurrence, not once per window containing it.
  *
  * @param str dna sequence
  * @param color color flag
  * @param reverse merge complements
  * @param m number of k-mers to minimize
  */
+template <typename policy>
 void graph::add_minimizers(uint64_t& T, string& str, uint16_t& color, bool& reverse, uint64_t& m) {
-    if (str.length() < (!isAmino ? kmer::k : kmerAmino::k)) return;    // not enough characters
+    if (str.length() < (!policy::amino ? kmer::k : kmerAmino::k)) return;    // not enough characters
 
-    vector<kmer_t> sequence_order;    // k-mers ordered by their position in sequence
-    multiset<kmer_t> value_order;    // k-mers ordered by their lexicographical value
-
-    vector<kmerAmino_t> sequence_order_Amino;    // k-mers ordered by their position in sequence
-    multiset<kmerAmino_t> value_order_Amino;    // k-mers ordered by their lexicographical value
+    uint64_t capacity = 1;    // the queue holds at most m k-mers, its capacity is a power of two
+    while (capacity < m) capacity <<= 1;
+    vector<uint64_t> queue_hash(capacity);    // the candidates for the window minimum, ascending by hash
+    vector<uint64_t> queue_pos(capacity);    // their positions, ascending
+    vector<kmer_t> queue_kmer(!policy::amino ? capacity : 0);
+    vector<kmerAmino_t> queue_kmerAmino(policy::amino ? capacity : 0);
+    uint64_t head, tail;    // the queue is [head, tail) modulo capacity
 
     uint64_t pos;    // current position in the string, from 0 to length
     kmer_t kmer;    // create a new empty bit sequence for the k-mer
     kmer_t rcmer;    // create a bit sequence for the reverse complement
-
     kmerAmino_t kmerAmino=0;    // create a new empty bit sequence for the k-mer
 
     uint64_t begin = 0;
+    uint64_t emitted;    // the position of the last added minimizer
+    uint_fast32_t bin;
 next_kmer:
     pos = begin;
-    sequence_order.clear();
-    sequence_order_Amino.clear();
-    value_order.clear();
-    sequence_order_Amino.clear();
-    
-    uint_fast32_t bin = 0;
-    uint_fast32_t amino_bin = 0;
+    head = tail = 0;
+    emitted = numeric_limits<uint64_t>::max();
 
     for (; pos < str.length(); ++pos) {    // collect the bases from the string
         if (!isAllowedChar(pos, str)) {
             begin = pos+1;    // str = str.substr(pos+1, string::npos);
             goto next_kmer;    // unknown base, start a new k-mer from the beginning
         }
-        if (!isAmino) {
-            kmer::shift(kmer, str[pos]);    // shift each base into the bit sequence
-
-            if (pos+1 - begin >= kmer::k) {
-                rcmer = kmer;
-		        // Test for multitables
-		        bool reversed = false;
-                if (reverse) {reversed = kmer::reverse_represent(rcmer);}    // invert the k-mer, if necessary
-
-                if (sequence_order.size() == m) {
-                    value_order.erase(*sequence_order.begin());    // remove k-mer outside the window
-                    sequence_order.erase(sequence_order.begin());
-                }
-                value_order.emplace(rcmer);    // insert k-mer ordered by its lexicographical value
-                sequence_order.emplace_back(rcmer);
-
-                if (sequence_order.size() == m) {
-                    bin = compute_bin(*value_order.begin());
-                    emplace_kmer(T, bin, *value_order.begin(), color);    // update the k-mer with the current color
-                }
-            }
+        uint64_t hash;
+        if (!policy::amino) {
+            uint_fast8_t right = util::char_to_bits(str[pos]);
+            kmer::shift(kmer, right);    // shift each base into the bit sequence
+            kmer::shift_reverse(rcmer, right);    // shift its complement into the reverse complement
+            if (pos+1 - begin < kmer::k) continue;
+            hash = mix_hash<kmer_t, minimizer_seed>()(reverse && rcmer < kmer ? rcmer : kmer);
         } else {
             kmerAmino::shift_right(kmerAmino, str[pos]);    // shift each base into the bit sequence
-            bin = compute_amino_bin(kmerAmino);
-            if (pos+1 - begin >= kmerAmino::k) {
-                if (sequence_order.size() == m) {
-                    value_order_Amino.erase(*sequence_order_Amino.begin());    // remove k-mer outside the window
-                    sequence_order_Amino.erase(sequence_order_Amino.begin());
-                }
-                value_order_Amino.emplace(kmerAmino);    // insert k-mer ordered by its lexicographical value
-                sequence_order_Amino.emplace_back(kmerAmino);
-
-                if (sequence_order_Amino.size() == m) {
-                    // Update the minimizer in the corresponding table
-                    emplace_kmer_amino(T, bin, *value_order_Amino.begin(), color);    // update the k-mer with the current color
-                }
-            }
+            if (pos+1 - begin < kmerAmino::k) continue;
+            hash = mix_hash<kmerAmino_t, minimizer_seed>()(kmerAmino);
+        }
+        if (tail != head && queue_pos[head & (capacity-1)] + m <= pos) head++;    // the minimum left the window
+        // drop the candidates that can no longer be the minimum, then append the current k-mer
+        while (tail != head && queue_hash[(tail-1) & (capacity-1)] > hash) tail--;
+        if (!policy::amino) queue_kmer[tail & (capacity-1)] = reverse && rcmer < kmer ? rcmer : kmer;
+        else queue_kmerAmino[tail & (capacity-1)] = kmerAmino;
+        queue_hash[tail & (capacity-1)] = hash;
+        queue_pos[tail & (capacity-1)] = pos;
+        tail++;
+
+        if (pos+1 - begin < (!policy::amino ? kmer::k : kmerAmino::k) + m-1) continue;    // the first window is incomplete
+        if (queue_pos[head & (capacity-1)] == emitted) continue;    // the minimizer is unchanged
+        emitted = queue_pos[head & (capacity-1)];
+        if (!policy::amino) {
+            bin = compute_bin(queue_kmer[head & (capacity-1)]);
+            emplace_kmer<policy>(T, bin, queue_kmer[head & (capacity-1)], color);    // update the k-mer with the current color
+        } else {
+            bin = compute_amino_bin(queue_kmerAmino[head & (capacity-1)]);
+            emplace_kmer_amino<policy>(T, bin, queue_kmerAmino[head & (capacity-1)], color);    // update the k-mer with the current color
         }
     }
 }
@@ -610,97 +1531,89 @@ bool graph::isAllowedChar(uint64_t pos, string &str) {
  * @param reverse merge complements
  * @param max_iupac allowed number of ambiguous k-mers per position
  */
+template <typename policy>
 void graph::add_kmers(uint64_t& T, string& str, uint16_t& color, bool& reverse, uint64_t& max_iupac) {
-    if (str.length() < (!isAmino ? kmer::k : kmerAmino::k)) return;    // not enough characters
+    if (str.length() < (!policy::amino ? kmer::k : kmerAmino::k)) return;    // not enough characters
 
     uint_fast32_t bin = 0;
 
-    if (!isAmino) {
-        hash_set<kmer_t> ping;    // create a new empty set for the k-mers
-        hash_set<kmer_t> pong;    // create another new set for the k-mers
-        bool ball; bool wait;    // indicates which of the two sets should be used
-
-        vector<uint8_t> factors;    // stores the multiplicity of iupac bases
-        long double product;    // stores the overall multiplicity of the k-mers
+    if (!policy::amino) {
+        iupac_window<false>& window = iupac_state[T];    // the resolutions of the current word
+        bool wait;    // indicates that there are too many ambiguous k-mers
 
         uint64_t pos;    // current position in the string, from 0 to length
-        kmer_t kmer;    // create an empty bit sequence for the initial k-mer
-        kmer_t rcmer;    // create a bit sequence for the reverse complement
+        kmer_t kmer;    // create a bit sequence for the canonical k-mer
 
         uint64_t begin = 0;
         next_kmer:
         pos = begin;
 
-        ping.clear(); pong.clear(); factors.clear();
-        ball = true; wait = false; product = 1;
-        (ball ? ping : pong).emplace(kmer);
+        window.reset();
+        wait = false;
 
         for (; pos < str.length(); ++pos) {    // collect the bases from the string
             if (str[pos] == '.' || str[pos] == '-') {
                 begin = pos+1;    // str = str.substr(pos+1, string::npos);
                 goto next_kmer;    // gap character, start a new k-mer from the beginning
             }
-            iupac_calc(product, factors, str[pos]);
+            window.count(str[pos]);
 
-            if (product <= max_iupac) {    // check if there are too many ambiguous k-mers
+            if (window.product <= max_iupac) {    // check if there are too many ambiguous k-mers
                 if (wait) {
                     begin = pos-kmer::k+1;    // str = str.substr(pos-kmer::k+1, string::npos);
                     goto next_kmer;    // start a new k-mer from the beginning
                 }
-                iupac_shift(ball ? ping : pong, !ball ? ping : pong, str[pos]);
-                ball = !ball;    // shift each base in, resolve iupac character
+                window.shift(str[pos]);    // shift each base in, resolve iupac character
             } else { wait = true; continue; }
 
             if (pos+1 - begin >= kmer::k) {
-                for (auto& kmer : (ball ? ping : pong)) {    // iterate over the current set of ambiguous k-mers
-                    rcmer = kmer;
-
-                    if (reverse) kmer::reverse_represent(rcmer);    // invert the k-mer, if necessary
-                    bin = compute_bin(rcmer);
-                    emplace_kmer(T, bin, rcmer, color);    // update the k-mer with the current color
+                kmer_t* kmers = window.kmers[window.ball].data();
+                kmer_t* rcmers = window.rcmers[window.ball].data();
+                for (uint64_t i = 0; i < window.size; ++i) {    // iterate over the current set of ambiguous k-mers
+                    kmer = reverse && rcmers[i] < kmers[i] ? rcmers[i] : kmers[i];    // invert the k-mer, if necessary
+                    if (scaled > 1 && !in_sample(kmer)) continue;    // not in the FracMinHash sample
+                    bin = compute_bin(kmer);
+                    emplace_kmer<policy>(T, bin, kmer, color);    // update the k-mer with the current color
                 }
             }
         }
     } 
     else {
-        hash_set<kmerAmino_t> ping;    // create a new empty set for the k-mers
-        hash_set<kmerAmino_t> pong;    // create another new set for the k-mers
-        bool ball; bool wait;    // indicates which of the two sets should be used
-
-        vector<uint8_t> factors;    // stores the multiplicity of iupac bases
-        long double product;    // stores the overall multiplicity of the k-mers
+        iupac_window<true>& window = iupac_stateAmino[T];    // the resolutions of the current word
+        bool wait;    // indicates that there are too many ambiguous k-mers
 
         uint64_t pos;    // current position in the string, from 0 to length
-        kmerAmino_t kmer=0;    // create an empty bit sequence for the initial k-mer
+        kmerAmino_t kmer;    // create a bit sequence for the current k-mer
 
         uint64_t begin = 0;
         next_kmerAmino:
         pos = begin;
 
-        ping.clear(); pong.clear(); factors.clear();
-        ball = true; wait = false; product = 1;
-        (ball ? ping : pong).emplace(kmer);
+        window.reset();
+        wait = false;
 
         for (; pos < str.length(); ++pos) {    // collect the bases from the string
             if (str[pos] == '.' || str[pos] == '-') {
                 begin = pos+1;    // str = str.substr(pos+1, string::npos);
                 goto next_kmerAmino;    // gap character, start a new k-mer from the beginning
             }
-            iupac_calc(product, factors, str[pos]);
+            window.count(str[pos]);
 
-            if (product <= max_iupac) {    // check if there are too many ambiguous k-mers
+            if (window.product <= max_iupac) {    // check if there are too many ambiguous k-mers
                 if (wait) {
                     begin = pos-kmerAmino::k+1;    // str = str.substr(pos-kmer::k+1, string::npos);
                     goto next_kmerAmino;    // start a new k-mer from the beginning
                 }
-                iupac_shift_amino(ball ? ping : pong, !ball ? ping : pong, str[pos]);
-                ball = !ball;    // shift each base in, resolve iupac character
+                window.shift(str[pos]);    // shift each acid in, resolve iupac character
             } else { wait = true; continue; }
 
             if (pos+1 - begin >= kmerAmino::k) {
-                for (auto& kmer : (ball ? ping : pong)) {    // iterate over the current set of ambiguous k-mers
-                    bin = compute_amino_bin(kmer);  
-                    emplace_kmer_amino(T, bin, kmer, color);  // update the k-mer with the current color
+                kmerAmino_t* kmers = window.kmers[window.ball].data();
+                for (uint64_t i = 0; i < window.size; ++i) {    // iterate over the current set of ambiguous k-mers
+                    kmer = kmers[i];
+                    if (scaled > 1 && !in_sample(kmer)) continue;    // not in the FracMinHash sample
+                    bin = compute_amino_bin(kmer);
+                    emplace_kmer_amino<policy>(T, bin, kmer, color);  // update the k-mer with the current color
                 }
             }
         }
@@ -709,6 +1622,8 @@ void graph::add_kmers(uint64_t& T, string& str, uint16_t& color, bool& reverse,
 
 /**
  * This function extracts k-mer minimizers from a sequence and adds them to the hash table.
+ * Each word is represented by its resolution with the smallest hash, the window minimum over these is maintained
+ * by a monotone queue as for unambiguous sequences, and each minimizer is added once per occurrence.
  *
  * @param str dna sequence
  * @param color color flag
@@ -716,306 +1631,150 @@ void graph::add_kmers(uint64_t& T, string& str, uint16_t& color, bool& reverse,
  * @param m number of k-mers to minimize
  * @param max_iupac allowed number of ambiguous k-mers per position
  */
+template <typename policy>
 void graph::add_minimizers(uint64_t& T, string& str, uint16_t& color, bool& reverse, uint64_t& m, uint64_t& max_iupac) {
-    if (str.length() < (!isAmino ? kmer::k : kmerAmino::k)) return;    // not enough characters
+    if (str.length() < (!policy::amino ? kmer::k : kmerAmino::k)) return;    // not enough characters
 
     uint_fast32_t bin = 0;
 
-   if (!isAmino) {
-       vector<kmer_t> sequence_order;    // k-mers ordered by their position in sequence
-       multiset<kmer_t> value_order;    // k-mers ordered by their lexicographical value
-       multiset<kmer_t> inner_value_order;
+    uint64_t capacity = 1;    // the queue holds at most m k-mers, its capacity is a power of two
+    while (capacity < m) capacity <<= 1;
+    vector<uint64_t> queue_hash(capacity);    // the candidates for the window minimum, ascending by hash
+    vector<uint64_t> queue_index(capacity);    // their indices among the words, ascending
+    uint64_t head, tail;    // the queue is [head, tail) modulo capacity
+    uint64_t index;    // the number of words with a resolution since the last restart
+    uint64_t emitted;    // the index of the last added minimizer
 
-       hash_set<kmer_t> ping;    // create a new empty set for the k-mers
-       hash_set<kmer_t> pong;    // create another new set for the k-mers
-       bool ball; bool wait;    // indicates which of the two sets should be used
+   if (!policy::amino) {
+       vector<kmer_t> queue_kmer(capacity);
 
-       vector<uint8_t> factors;    // stores the multiplicity of iupac bases
-       long double product;    // stores the overall multiplicity of the k-mers
+       iupac_window<false>& window = iupac_state[T];    // the resolutions of the current word
+       bool wait;    // indicates that there are too many ambiguous k-mers
 
        uint64_t pos;    // current position in the string, from 0 to length
-       kmer_t kmer;    // create an empty bit sequence for the initial k-mer
-       kmer_t rcmer;    // create a bit sequence for the reverse complement
+       kmer_t kmer;    // create a bit sequence for the canonical k-mer
+       kmer_t inner_min;    // the resolution of the current word with the smallest hash
+       uint64_t inner_hash;    // its hash
 
        uint64_t begin = 0;
        next_kmer:
        pos = begin;
-       sequence_order.clear();
-       value_order.clear();
+       head = tail = index = 0;
+       emitted = numeric_limits<uint64_t>::max();
 
-       ping.clear(); pong.clear(); factors.clear();
-       ball = true; wait = false; product = 1;
-       (ball ? ping : pong).emplace(kmer);
+       window.reset();
+       wait = false;
 
        for (; pos < str.length(); ++pos) {    // collect the bases from the string
            if (str[pos] == '.' || str[pos] == '-') {
                begin = pos+1;    // str = str.substr(pos+1, string::npos);
                goto next_kmer;    // gap character, start a new k-mer from the beginning
            }
-           iupac_calc(product, factors, str[pos]);
+           window.count(str[pos]);
 
-           if (product <= max_iupac) {    // check if there are too many ambiguous k-mers
+           if (window.product <= max_iupac) {    // check if there are too many ambiguous k-mers
                if (wait) {
                    begin = pos-kmer::k+1;    // str = str.substr(pos-kmer::k+1, string::npos);
                    goto next_kmer;    // start a new k-mer from the beginning
                }
-               iupac_shift(ball ? ping : pong, !ball ? ping : pong, str[pos]);
-               ball = !ball;    // shift each base in, resolve iupac character
+               window.shift(str[pos]);    // shift each base in, resolve iupac character
            } else { wait = true; continue; }
 
-           if (pos+1 - begin >= kmer::k) {
-               for (auto& kmer : (ball ? ping : pong)) {    // iterate over the current set of ambiguous k-mers
-                   rcmer = kmer;
-		   if (reverse) kmer::reverse_represent(rcmer);    // invert the k-mer, if necessary
-                   inner_value_order.emplace(rcmer);
-               }
-
-               if (sequence_order.size() == m) {
-                   value_order.erase(*sequence_order.begin());    // remove k-mer outside the window
-                   sequence_order.erase(sequence_order.begin());
+           if (pos+1 - begin >= kmer::k && window.size > 0) {
+               kmer_t* kmers = window.kmers[window.ball].data();
+               kmer_t* rcmers = window.rcmers[window.ball].data();
+               inner_hash = numeric_limits<uint64_t>::max();
+               for (uint64_t i = 0; i < window.size; ++i) {    // iterate over the current set of ambiguous k-mers
+                   kmer = reverse && rcmers[i] < kmers[i] ? rcmers[i] : kmers[i];    // invert the k-mer, if necessary
+                   uint64_t hash = mix_hash<kmer_t, minimizer_seed>()(kmer);
+                   if (hash < inner_hash) {inner_hash = hash; inner_min = kmer;}
                }
-               value_order.emplace(*inner_value_order.begin());    // insert k-mer ordered by its lexicographical value
-               sequence_order.emplace_back(*inner_value_order.begin());
-               inner_value_order.clear();
 
-               if (sequence_order.size() == m) {
-                    bin = compute_bin(*value_order.begin());
-                    emplace_kmer(T, bin, *value_order.begin(), color);    // update the k-mer with the current color
-               }
+               if (tail != head && queue_index[head & (capacity-1)] + m <= index) head++;    // the minimum left the window
+               // drop the candidates that can no longer be the minimum, then append the current word
+               while (tail != head && queue_hash[(tail-1) & (capacity-1)] > inner_hash) tail--;
+               queue_kmer[tail & (capacity-1)] = inner_min;
+               queue_hash[tail & (capacity-1)] = inner_hash;
+               queue_index[tail & (capacity-1)] = index;
+               tail++;
+
+               if (++index < m) continue;    // the first window is incomplete
+               if (queue_index[head & (capacity-1)] == emitted) continue;    // the minimizer is unchanged
+               emitted = queue_index[head & (capacity-1)];
+               bin = compute_bin(queue_kmer[head & (capacity-1)]);
+               emplace_kmer<policy>(T, bin, queue_kmer[head & (capacity-1)], color);    // update the k-mer with the current color
            }
        }
    } 
    else {
-       vector<kmerAmino_t> sequence_order;    // k-mers ordered by their position in sequence
-       multiset<kmerAmino_t> value_order;    // k-mers ordered by their lexicographical value
-       multiset<kmerAmino_t> inner_value_order;
-
-       hash_set<kmerAmino_t> ping;    // create a new empty set for the k-mers
-       hash_set<kmerAmino_t> pong;    // create another new set for the k-mers
-       bool ball; bool wait;    // indicates which of the two sets should be used
+       vector<kmerAmino_t> queue_kmerAmino(capacity);
 
-       vector<uint8_t> factors;    // stores the multiplicity of iupac bases
-       long double product;    // stores the overall multiplicity of the k-mers
+       iupac_window<true>& window = iupac_stateAmino[T];    // the resolutions of the current word
+       bool wait;    // indicates that there are too many ambiguous k-mers
 
        uint64_t pos;    // current position in the string, from 0 to length
-       kmerAmino_t kmer=0;    // create an empty bit sequence for the initial k-mer
+       kmerAmino_t inner_min;    // the resolution of the current word with the smallest hash
+       uint64_t inner_hash;    // its hash
 
        uint64_t begin = 0;
        next_kmerAmino:
        pos = begin;
-       sequence_order.clear();
-       value_order.clear();
+       head = tail = index = 0;
+       emitted = numeric_limits<uint64_t>::max();
 
-       ping.clear(); pong.clear(); factors.clear();
-       ball = true; wait = false; product = 1;
-       (ball ? ping : pong).emplace(kmer);
+       window.reset();
+       wait = false;
 
        for (; pos < str.length(); ++pos) {    // collect the bases from the string
            if (str[pos] == '.' || str[pos] == '-') {
                begin = pos+1;    // str = str.substr(pos+1, string::npos);
                goto next_kmerAmino;    // gap character, start a new k-mer from the beginning
            }
-           iupac_calc(product, factors, str[pos]);
+           window.count(str[pos]);
 
-           if (product <= max_iupac) {    // check if there are too many ambiguous k-mers
+           if (window.product <= max_iupac) {    // check if there are too many ambiguous k-mers
                if (wait) {
                    begin = pos-kmerAmino::k+1;    // str = str.substr(pos-kmer::k+1, string::npos);
                    goto next_kmerAmino;    // start a new k-mer from the beginning
                }
-               iupac_shift_amino(ball ? ping : pong, !ball ? ping : pong, str[pos]);
-               ball = !ball;    // shift each base in, resolve iupac character
+               window.shift(str[pos]);    // shift each acid in, resolve iupac character
            } else { wait = true; continue; }
 
-           if (pos+1 - begin >= kmerAmino::k) {
-               for (auto& kmer : (ball ? ping : pong)) {    // iterate over the current set of ambiguous k-mers
-                   inner_value_order.emplace(kmer);
+           if (pos+1 - begin >= kmerAmino::k && window.size > 0) {
+               kmerAmino_t* kmers = window.kmers[window.ball].data();
+               inner_hash = numeric_limits<uint64_t>::max();
+               for (uint64_t i = 0; i < window.size; ++i) {    // iterate over the current set of ambiguous k-mers
+                   uint64_t hash = mix_hash<kmerAmino_t, minimizer_seed>()(kmers[i]);
+                   if (hash < inner_hash) {inner_hash = hash; inner_min = kmers[i];}
                }
 
-               if (sequence_order.size() == m) {
-                   value_order.erase(*sequence_order.begin());    // remove k-mer outside the window
-                   sequence_order.erase(sequence_order.begin());
-               }
-               value_order.emplace(*inner_value_order.begin());    // insert k-mer ordered by its lexicographical value
-               sequence_order.emplace_back(*inner_value_order.begin());
-               inner_value_order.clear();
-
-               if (sequence_order.size() == m) {
-                   // Todo: Get the target hash map index from the kmer bits
-                   bin = compute_amino_bin(*value_order.begin());
-                   emplace_kmer_amino(T, bin, *value_order.begin(), color);    // update the k-mer with the current color
-               }
+               if (tail != head && queue_index[head & (capacity-1)] + m <= index) head++;    // the minimum left the window
+               // drop the candidates that can no longer be the minimum, then append the current word
+               while (tail != head && queue_hash[(tail-1) & (capacity-1)] > inner_hash) tail--;
+               queue_kmerAmino[tail & (capacity-1)] = inner_min;
+               queue_hash[tail & (capacity-1)] = inner_hash;
+               queue_index[tail & (capacity-1)] = index;
+               tail++;
+
+               if (++index < m) continue;    // the first window is incomplete
+               if (queue_index[head & (capacity-1)] == emitted) continue;    // the minimizer is unchanged
+               emitted = queue_index[head & (capacity-1)];
+               bin = compute_amino_bin(queue_kmerAmino[head & (capacity-1)]);
+               emplace_kmer_amino<policy>(T, bin, queue_kmerAmino[head & (capacity-1)], color);    // update the k-mer with the current color
            }
        }
    }
 }
 
-/**
- * This function calculates the multiplicity of iupac k-mers.
- *
- * @param product overall multiplicity
- * @param factors per base multiplicity
- * @param input iupac character
- */
-void graph::iupac_calc(long double& product, vector<uint8_t>& factors, char& input) {
-
-    if(!isAmino){
-        switch (input) {
-            case 'A': case 'C': case 'G': case 'T':
-                product *= 1;
-                factors.emplace_back(1);
-        }
-        switch (input) {
-            case 'R': case 'Y': case 'S': case 'W': case 'K': case 'M':
-                product *= 2;
-                factors.emplace_back(2);
-        }
-        switch (input) {
-            case 'B': case 'D': case 'H': case 'V':
-                product *= 3;
-                factors.emplace_back(3);
-        }
-        switch (input) {
-            case 'N':
-                product *= 4;
-                factors.emplace_back(4);
-        }
-        if (factors.size() > kmer::k) {
-            product /= *factors.begin();
-            factors.erase(factors.begin());
-        }
-    }else{
-        switch (input) {
-            case 'A': case 'C': case 'D': case 'E': case 'F': case 'G':
-            case 'H': case 'I': case 'K': case 'L': case 'M': case 'N':
-            case 'O': case 'P': case 'Q': case 'R': case 'S': case 'T':
-            case 'U': case 'V': case 'W': case 'Y': case '*':
-                product *= 1;
-                factors.emplace_back(1);
-        }
-        switch (input) {
-            case 'B': case 'Z': case 'J':
-                product *= 2;
-                factors.emplace_back(2);
-        }
-        switch (input) {
-            case 'X':
-                product *= 22;
-                factors.emplace_back(22);
-        }
-        if (factors.size() > kmerAmino::k) {
-            product /= *factors.begin();
-            factors.erase(factors.begin());
-        }
-    }
-
-
-
-}
-
-/**
- * This function shifts a base into a set of ambiguous iupac k-mers.
- *
- * @param prev set of k-mers
- * @param next set of k-mers
- * @param input iupac character
- */
-void graph::iupac_shift(hash_set<kmer_t>& prev, hash_set<kmer_t>& next, char& input) {
-    kmer_t temp; char base;
-    while (!prev.empty()) {    // extend each previous k-mer
-        switch (input) {
-            case 'A': case 'R': case 'W': case 'M':
-            case 'D': case 'H': case 'V': case 'N':
-                temp = *prev.begin(); base = 'A';
-                kmer::shift(temp, base);
-                next.emplace(temp);
-        }
-        switch (input) {
-            case 'C': case 'Y': case 'S': case 'M':
-            case 'B': case 'H': case 'V': case 'N':
-                temp = *prev.begin(); base = 'C';
-                kmer::shift(temp, base);
-                next.emplace(temp);
-        }
-        switch (input) {
-            case 'G': case 'R': case 'S': case 'K':
-            case 'B': case 'D': case 'V': case 'N':
-                temp = *prev.begin(); base = 'G';
-                kmer::shift(temp, base);
-                next.emplace(temp);
-        }
-        switch (input) {
-            case 'T': case 'Y': case 'W': case 'K':
-            case 'B': case 'D': case 'H': case 'N':
-                temp = *prev.begin(); base = 'T';
-                kmer::shift(temp, base);
-                next.emplace(temp);
-        }
-        prev.erase(prev.begin());
-    }
-}
-
-/**
- * This function shifts an amino acid into a set of ambiguous iupac k-mers.
- *
- * @param prev set of k-mers
- * @param next set of k-mers
- * @param input iupac character
- */
-void graph::iupac_shift_amino(hash_set<kmerAmino_t>& prev, hash_set<kmerAmino_t>& next, char& input) {
-    string acidsUnique = "ACDEFGHIKLMNOPQRSTUVWY*";
-    string acidsB = "DN";
-    string acidsZ = "EQ";
-    string acidsJ = "LI";
-
-    kmerAmino_t temp; char acid;
-    while (!prev.empty()) {    // extend each previous k-mer
-
-        //first: all unique acids OR X for all
-        for (char i : acidsUnique) {
-            acid = i;
-            if (acid == input || input == 'X') {
-                temp = *prev.begin();
-                kmerAmino::shift_right(temp, acid);
-                next.emplace(temp);
-            }
-        }
-
-        //second: all ambigious acids
-
-        if (input == 'B') {
-            for (char i : acidsB) {
-                temp = *prev.begin();
-                acid = i;
-                kmerAmino::shift_right(temp, acid);
-                next.emplace(temp);
-            }
-        } //second: all ambigious acids
-
-        if (input == 'Z') {
-            for (char i : acidsZ) {
-                temp = *prev.begin();
-                acid = i;
-                kmerAmino::shift_right(temp, acid);
-                next.emplace(temp);
-            }
-        }
-
-        if (input == 'J'){
-            for (char i : acidsJ) {
-                temp = *prev.begin();
-                acid = i;
-                kmerAmino::shift_right(temp, acid);
-                next.emplace(temp);
-            }
-        }
-        prev.erase(prev.begin());
-    }
-}
-
 /**
  * This function clears color-related temporary files.
  */
 void graph::clear_thread(uint64_t& T) {
+    if (genome_counting) return;    // the shared counters are released per genome
+    if (deduplicating || sketching) {
+        isAmino ? quality_mapAmino[T].clear() : quality_map[T].clear();
+        return;
+    }
     switch (quality) {
         case 1:  case 0: break;
         case 2:  isAmino ? quality_setAmino[T].clear() : quality_set[T].clear(); break;
@@ -1040,12 +1799,201 @@ void graph::add_cdbg_colored_kmer(string kmer_seq, const uint16_t& kmer_color){
         }
 
 	    bool reversed = kmer::reverse_represent(kmer);
+	    if (scaled > 1 && !in_sample(kmer)) return;    // not in the FracMinHash sample
 
 		uint_fast32_t bin = compute_bin(kmer);
 		hash_kmer<true>(bin, kmer, kmer_color);    // update the k-mer with the current color
 
 }
 
+/*
+*
+* [Sort-based counting]
+*
+*/
+
+/**
+ * This function sorts (k-mer, color) pairs by their k-mer with an LSD radix sort over the bytes of the k-mer.
+ * Bytes in which all k-mers agree are skipped.
+ *
+ * @param pairs the pairs to sort
+ * @param temp buffer of the same type, resized as needed
+ * @param bits the number of bits used by a k-mer
+ */
+template <typename K>
+void radix_sort(vector<colored_kmer<K>>& pairs, vector<colored_kmer<K>>& temp, const uint_fast32_t& bits) {
+    if (pairs.size() < 2) return;
+    uint_fast32_t digits = (bits+7) / 8;
+
+    // count the byte values of all digits in a single pass
+    vector<array<uint64_t,256>> count(digits);
+    for (auto& digit : count) digit.fill(0);
+    for (auto& pair : pairs) {
+        for (uint_fast32_t d = 0; d < digits; ++d) count[d][pair.kmer.octet(d)]++;
+    }
+
+    temp.resize(pairs.size());
+    for (uint_fast32_t d = 0; d < digits; ++d) {
+        if (count[d][pairs[0].kmer.octet(d)] == pairs.size()) continue;    // all k-mers agree in this byte
+        uint64_t sum = 0;
+        for (auto& c : count[d]) {uint64_t n = c; c = sum; sum += n;}    // prefix sums as scatter offsets
+        for (auto& pair : pairs) temp[count[d][pair.kmer.octet(d)]++] = pair;
+        pairs.swap(temp);
+    }
+}
+
+/**
+ * This function sorts the partitions of a pair buffer in parallel and reduces each run of equal k-mers to its color set.
+ * Singleton k-mers are counted per genome, all others are weighted in the color table as add_weights would do.
+ *
+ * @param buffer per-thread pair buffers, one for each partition (released during processing)
+ * @param core collects the core k-mers
+ * @param bits the number of bits used by a k-mer
+ * @param thread_count the number of threads used for processing
+ * @param keep_core collect the core k-mers
+ * @param verbose print progress
+ */
+template <typename K>
+void graph::reduce_partitions(vector<vector<vector<colored_kmer<K>>>>& buffer, vector<K>& core, const uint_fast32_t& bits, uint64_t& thread_count, bool keep_core, bool& verbose) {
+    uint64_t index = 0, prog = 0, next;
+    std::mutex index_mutex;    // guards the index of the next partition
+    std::mutex merge_mutex;    // guards the global tables and counters
+    uint64_t memory_used = 0;    // the bytes of the partitions being reduced, guarded by the memory mutex
+    std::mutex memory_mutex;
+    condition_variable memory_released;
+
+    auto lambda = [&] () {
+        hash_map<split_color_t, array<uint32_t,2>> local_color_table;    // thread-local color table, merged at the end
+        vector<uint64_t> local_counters(maxN, 0), local_singletons(maxN, 0);
+        vector<K> local_core;
+        uint64_t local_count = 0;
+        vector<colored_kmer<K>> pairs, temp;
+        vector<uint32_t> occurrences(sort_counting ? maxN : 0, 0);    // occurrences per genome in the current run
+
+        while (true) {
+            uint64_t p;
+            {
+                std::lock_guard<mutex> lg(index_mutex);
+                p = index++;
+                if (verbose && p < partition_count) {
+                    next = 100*p/partition_count;
+                    if (prog < next)  cout << "\33[2K\r" << "Sorting k-mers... " << next << "%" << flush;
+                    prog = next;
+                }
+            }
+            if (p >= partition_count) break;
+
+            // gather the partition from its spilled part (if any) and all thread buffers
+            uint64_t size = 0, spilled = 0;
+            ifstream file;
+            if (!bucket_dir.empty()) {
+                file.open(bucket_path(p), ios::binary | ios::ate);
+                if (file.good()) {spilled = file.tellg() / sizeof(colored_kmer<K>); file.seekg(0);}
+            }
+            for (auto& thread_buffer : buffer) size += thread_buffer[p].size();
+
+            // wait until the partition and the temporary array of the sort fit the memory limit (or nothing else is reduced)
+            uint64_t memory = 2 * (spilled + size) * sizeof(colored_kmer<K>);
+            if (memory_budget) {
+                unique_lock<mutex> lg(memory_mutex);
+                memory_released.wait(lg, [&] () {return memory_used == 0 || memory_used + memory <= memory_budget;});
+                memory_used += memory;
+            }
+
+            pairs.clear(); pairs.reserve(spilled + size);
+            if (spilled > 0) {
+                pairs.resize(spilled);
+                if (!file.read(reinterpret_cast<char*>(pairs.data()), spilled * sizeof(colored_kmer<K>))) {
+                    cerr << "Error: could not read k-mers from " << bucket_path(p) << endl;
+                    exit(1);
+                }
+            }
+            if (file.is_open()) {file.close(); remove(bucket_path(p).c_str());}
+            for (auto& thread_buffer : buffer) {
+                pairs.insert(pairs.end(), thread_buffer[p].begin(), thread_buffer[p].end());
+                vector<colored_kmer<K>>().swap(thread_buffer[p]);    // release the buffer
+            }
+            radix_sort(pairs, temp, bits);
+
+            // reduce each run of equal k-mers to its color set
+            auto it = pairs.begin();
+            while (it != pairs.end()) {
+                auto run = it;
+                split_color_t color = color_t(0b0u);
+                uint16_t single = run->color;    // the genome of a singleton k-mer
+                for (; it != pairs.end() && it->kmer == run->kmer; ++it) {
+                    // count the occurrences per genome until its threshold is reached
+                    if (sort_counting && ++occurrences[it->color] != (uint32_t) (q_table.empty() ? quality : q_table[it->color])) continue;
+                    if (!color.test(it->color)) {    // count a new (unique) k-mer of this genome
+                        color.set(it->color);
+                        local_counters[it->color]++;
+                        single = it->color;
+                    }
+                }
+                if (sort_counting) for (auto r = run; r != it; ++r) occurrences[r->color] = 0;
+                uint64_t genomes = color.popcnt();
+                if (genomes == 0) continue;    // below the threshold in all genomes
+                if (genomes == 1) {local_singletons[single]++; continue;}
+                local_count++;
+                if (keep_core && genomes == color::n) local_core.push_back(run->kmer);
+
+                bool pos = color::represent(color);    // invert the color set, if necessary
+                if (color.popcnt() == 0) continue;    // ignore empty splits
+                local_color_table[color][pos]++;
+            }
+
+            if (memory_budget) {    // release the arrays, the next partition may be reduced by another thread
+                vector<colored_kmer<K>>().swap(pairs);
+                vector<colored_kmer<K>>().swap(temp);
+                {
+                    std::lock_guard<mutex> lg(memory_mutex);
+                    memory_used -= memory;
+                }
+                memory_released.notify_all();
+            }
+        }
+
+        // merge the thread-local results
+        std::lock_guard<mutex> lg(merge_mutex);
+        for (auto& entry : local_color_table) {
+            array<uint32_t,2>& weight = color_table[entry.first];
+            weight[0] += entry.second[0];
+            weight[1] += entry.second[1];
+        }
+        for (uint64_t i = 0; i < maxN; ++i) {
+            kmer_counters[i] += local_counters[i];
+            singleton_counters[i] += local_singletons[i];
+        }
+        core.insert(core.end(), local_core.begin(), local_core.end());
+        sorted_kmer_count += local_count;
+    };
+
+    vector<thread> thread_holder(thread_count);
+    for (uint64_t thread_id = 0; thread_id < thread_count; ++thread_id){thread_holder[thread_id] = thread(lambda);}
+    for (uint64_t thread_id = 0; thread_id < thread_count; ++thread_id){thread_holder[thread_id].join();}
+    buffer.clear();
+    remove_buckets();
+}
+
+/**
+ * This function sorts the buffered (k-mer, color) pairs and reduces them into the color table and the k-mer counters.
+ *
+ * @param thread_count the number of threads used for processing
+ * @param keep_core collect the core k-mers for output_core
+ * @param verbose print progress
+ */
+void graph::sort_kmers(uint64_t& thread_count, bool keep_core, bool& verbose) {
+    // with a memory limit, the remaining buffers are spilled as well, so only the partitions being reduced are in memory
+    if (!bucket_dir.empty()) {
+        for (uint64_t T = 0; T < thread_count; ++T) spill_buffer(T);
+    }
+    if (!isAmino) {
+        reduce_partitions(kmer_buffer, core_kmers, 2*kmer::k, thread_count, keep_core, verbose);
+    } else {
+        reduce_partitions(kmer_bufferAmino, core_kmersAmino, 5*kmerAmino::k, thread_count, keep_core, verbose);
+    }
+}
+
 /*
 *
 * [Color table processing]
@@ -1054,64 +2002,43 @@ void graph::add_cdbg_colored_kmer(string kmer_seq, const uint16_t& kmer_color){
 
 /**
  * This function iterates over the hash table and calculates the split weights.
+ * The bins (or the color classes of the frozen tables) are partitioned among the threads, see accumulate_colors.
  * 
  * @param mean weight function
  * @param min_value the minimal weight represented in the top list
+ * @param thread_count the number of threads used for processing
  * @param verbose print progess
  */
-void graph::add_weights(double mean(uint32_t&, uint32_t&), double min_value, bool& verbose) {
-	
-	
-	
-    //double min_value = numeric_limits<double>::min(); // current min. weight in the top list (>0)
-    uint64_t cur=0, prog=0, next;
+void graph::add_weights(double mean(uint64_t&, uint64_t&), double min_value, uint64_t& thread_count, bool& verbose) {
+    const string step = "Accumulating splits from non-singleton k-mers... ";
+
+    // frozen tables: each color class adds the number of its k-mers at once
+    if (frozen) {
+        accumulate_colors(color_classes.size(), [&] (const uint64_t& i, auto& add) {
+            add(color_classes[i], class_sizes[i]);
+        }, thread_count, step, verbose);
+        return;
+    }
 
     // check table (Amino or base)
     uint64_t max = 0; // table size
-    if (isAmino){for (auto table: kmer_tableAmino){max += table.size();}} // use the sum of amino table sizes
-    else {for (auto table: kmer_table){max+=table.size();}} // use the sum of base table sizes
+    if (isAmino){for (auto& table: kmer_tableAmino){max += table.size();}} // use the sum of amino table sizes
+    else {for (auto& table: kmer_table){max+=table.size();}} // use the sum of base table sizes
 
     // If the tables are empty, there is nothing to be done	    
     if (max==0){
         return;
     }
-    // The iterators for the tables
-    hash_map<kmer_t, color_t>::iterator base_it;
-    hash_map<kmerAmino_t, color_t>::iterator amino_it;
-
-    // Iterate the tables
-    for (int i = 0; i < graph::table_count; i++) // Iterate all tables
-    {
-        if (!isAmino){base_it = kmer_table[i].begin();} // base table iterator
-        else {amino_it = kmer_tableAmino[i].begin();} // amino table iterator
 
-        while (true) { // process splits
-            // show progress
-            if (verbose) { 
-                next = 100*cur/max;
-                if (prog < next)  cout << "\33[2K\r" << "Accumulating splits from non-singleton k-mers... " << next << "%" << flush;
-                prog = next; cur++;
-            }
-            // update the iterator
-            color_t* color_ref; // reference of the current color
-            if (isAmino) { // if the amino table is used, update the amino iterator
-                
-                if (amino_it == kmer_tableAmino[i].end()){break;} // stop iterating if done
-                else{color_ref = &amino_it.value(); ++amino_it;} // iterate the amino table
-                }
-            else { // if the base tables is used update the base iterator
-                // Todo: Get the target hash map index from the kmer bits
-                if (base_it == kmer_table[i].end()){break;} // stop itearating if done
-                else {color_ref = &base_it.value(); ++base_it;} // iterate the base table
-                }
-            // process
-            color_t& color = *color_ref;
-            bool pos = color::represent(color);    // invert the color set, if necessary
-            if (color == 0) continue;    // ignore empty splits
-            // add_weight(color, mean, min_value, pos);
-			array<uint32_t,2>& weight = color_table[color];    // get the weight and inverse weight for the color set
-			weight[pos]++; // update the weight or the inverse weight of the current color set
-		}
+    // Iterate the tables, a bin per item
+    if (!isAmino) {
+        accumulate_colors(table_count, [&] (const uint64_t& i, auto& add) {
+            for (auto it = kmer_table[i].begin(); it != kmer_table[i].end(); ++it) add(it.value(), 1);
+        }, thread_count, step, verbose);
+    } else {
+        accumulate_colors(table_count, [&] (const uint64_t& i, auto& add) {
+            for (auto it = kmer_tableAmino[i].begin(); it != kmer_tableAmino[i].end(); ++it) add(it.value(), 1);
+        }, thread_count, step, verbose);
     }
 }
 
@@ -1125,7 +2052,7 @@ void graph::add_weights(double mean(uint32_t&, uint32_t&), double min_value, boo
  * @param min_value the minimal weight represented in the top list
  * @param verbose print progess
  */
-void graph::add_singleton_weights(double mean(uint32_t&, uint32_t&), double min_value, bool& verbose) {
+void graph::add_singleton_weights(double mean(uint64_t&, uint64_t&), double min_value, bool& verbose) {
 	
 	// not needed anymore
 	singleton_kmer_table.clear();
@@ -1168,35 +2095,99 @@ void graph::add_singleton_weights(double mean(uint32_t&, uint32_t&), double min_
 
 
 /**
- * This function calculates the weight for all splits and puts them into the split_ölist
+ * A top list of splits in the order of the split list, i.e., by weight descending and ties by color.
+ * The candidates are collected in a flat array, which is trimmed to the first t by selection whenever it doubles.
+ */
+struct top_splits {
+    vector<pair<double, color_t>> splits;
+    uint64_t t;
+    double min_value;    // the weight of the last split, once t splits are kept
+
+    top_splits(const uint64_t& t, const double& min_value) : t(t), min_value(min_value) {}
+
+    void add(const double& weight, const color_t& color) {
+        if (weight < min_value) return;
+        splits.emplace_back(weight, color);
+        if (splits.size() > t && splits.size() - t >= t) trim();
+    }
+
+    void trim() {
+        if (splits.size() <= t) return;
+        if (t == 0) {splits.clear(); return;}
+        nth_element(splits.begin(), splits.begin() + t-1, splits.end(), compare<double, color_t>());
+        splits.resize(t);
+        min_value = splits.back().first;
+    }
+
+    /**
+     * Keeps the first t splits and sorts them.
+     */
+    void finish() {
+        trim();
+        sort(splits.begin(), splits.end(), compare<double, color_t>());
+    }
+};
+
+/**
+ * This function merges the sorted top lists of the threads pairwise in parallel, keeping the first t splits.
+ *
+ * @param runs the sorted top lists (released)
+ * @param t the number of splits to keep
+ * @return the first t splits, sorted
+ */
+static vector<pair<double, color_t>> merge_top_splits(vector<vector<pair<double, color_t>>>& runs, const uint64_t& t) {
+    while (runs.size() > 1) {
+        vector<vector<pair<double, color_t>>> merged((runs.size()+1) / 2);
+        auto lambda_merge = [&] (uint64_t j) {
+            if (2*j+1 == runs.size()) {merged[j] = move(runs[2*j]); return;}
+            auto& a = runs[2*j]; auto& b = runs[2*j+1];
+            merged[j].resize(a.size() + b.size());
+            std::merge(a.begin(), a.end(), b.begin(), b.end(), merged[j].begin(), compare<double, color_t>());
+            if (merged[j].size() > t) merged[j].resize(t);
+            vector<pair<double, color_t>>().swap(a);
+            vector<pair<double, color_t>>().swap(b);
+        };
+        vector<thread> thread_holder(merged.size());
+        for (uint64_t j = 0; j < merged.size(); ++j){thread_holder[j] = thread(lambda_merge, j);}
+        for (uint64_t j = 0; j < merged.size(); ++j){thread_holder[j].join();}
+        runs = move(merged);
+    }
+    return runs.empty() ? vector<pair<double, color_t>>() : move(runs[0]);
+}
+
+/**
+ * This function calculates the weight for all splits and puts them into the split_ölist.
+ * The colors are partitioned among the threads, each selects its own top list, and the sorted top lists are merged.
+ * The result is the same as inserting all splits into the split list one by one.
  * @param mean weight function
  * @param min_value the minimal weight represented in the top list
+ * @param thread_count the number of threads used for computing and selecting the weights
  */
-void graph::compile_split_list(double mean(uint32_t&, uint32_t&), double min_value)
+void graph::compile_split_list(double mean(uint64_t&, uint64_t&), double min_value, uint64_t& thread_count)
 {
-	// Iterating over the map using Iterator till map end.
-	hash_map<color_t, array<uint32_t,2>>::iterator it = color_table.begin();
-	while (it != color_table.end())	{
-
-		// Accessing the key
-		color_t colors = it->first;
-		
-		// Accessing the value
-		array<uint32_t,2> weights = it->second;
-		
-		//insert into split list
-		double new_mean = mean(weights[0], weights[1]);    // calculate the mean value
-		if (new_mean >= min_value) {    // if it is greater than the min. value, add it to the top list
-			split_list.emplace(new_mean, colors);    // insert it at the correct position ordered by weight
-			if (split_list.size() > t) {
-				split_list.erase(--split_list.end());    // if the top list exceeds its limit, erase the last entry
-				min_value = split_list.rbegin()->first;    // update the min. value for the next iteration (only necessary of t is exceeded, otherwise min_value does not play a role.
-			}
+	// the entries of the color table, to be partitioned among the threads
+	vector<const pair<split_color_t, array<uint32_t,2>>*> entries;
+	entries.reserve(color_table.size());
+	for (auto& entry : color_table) entries.push_back(&entry);
+
+	vector<vector<pair<double, color_t>>> runs(thread_count);
+	auto lambda = [&] (uint64_t T) {
+		top_splits top(t, min_value);
+		for (uint64_t i = T * entries.size() / thread_count; i < (T+1) * entries.size() / thread_count; ++i) {
+			// estimate the weights of all k-mers from the FracMinHash sample (in 64 bits, the scaled weights may exceed 32 bits)
+			array<uint64_t,2> weights = {entries[i]->second[0] * scaled, entries[i]->second[1] * scaled};
+			top.add(mean(weights[0], weights[1]), entries[i]->first);    // calculate the mean value
 		}
-		
-		// iterator incremented to point next item
-		it++;
-	}
+		top.finish();
+		runs[T] = move(top.splits);
+	};
+	vector<thread> thread_holder(thread_count);
+	for (uint64_t thread_id = 0; thread_id < thread_count; ++thread_id){thread_holder[thread_id] = thread(lambda, thread_id);}
+	for (uint64_t thread_id = 0; thread_id < thread_count; ++thread_id){thread_holder[thread_id].join();}
+
+	// insert the sorted splits at the end of the list
+	for (auto& split : merge_top_splits(runs, t)) split_list.emplace_hint(split_list.end(), split);
+	while (split_list.size() > t) split_list.erase(--split_list.end());
 }
 
 /**
@@ -1209,18 +2200,47 @@ void graph::output_core(ostream& file, bool& verbose)
 {
     uint64_t cur=0, prog=0, next, core_count=0, all_count=0, singletons_count=0;
 
+    // the core k-mers have already been collected while reducing the sorted buffers
+    if (sorting) {
+        all_count = number_kmers();
+        if (all_count==0){
+            return;
+        }
+        for (kmer_t kmer : core_kmers) {file << ">" << endl << kmer::kmer_to_string(kmer) << endl;}
+        for (kmerAmino_t kmer : core_kmersAmino) {file << ">" << endl << kmerAmino::kmer_to_string(kmer) << endl;}
+        core_count = core_kmers.size() + core_kmersAmino.size();
+        if (verbose) {
+            cout  << "\33[2K\r" << "Collecting core k-mers... (" << core_count << " / "<< (100*core_count/all_count) << "%)"<< flush;
+        }
+        return;
+    }
+
+    // the frozen k-mers of complete color classes
+    if (frozen) {
+        all_count = number_kmers();
+        for (uint64_t i = 0; i < frozen_classes.size(); ++i) {
+            if (!color::is_complete(color_classes[frozen_classes[i]])) continue;
+            core_count++;
+            file << ">" << endl << (isAmino ? kmerAmino::kmer_to_string(frozen_kmersAmino[i]) : kmer::kmer_to_string(frozen_kmers[i])) << endl;
+        }
+        if (verbose && all_count > 0) {
+            cout  << "\33[2K\r" << "Collecting core k-mers... (" << core_count << " / "<< (100*core_count/all_count) << "%)"<< flush;
+        }
+        return;
+    }
+
     // check table (Amino or base)
     uint64_t max = 0; // table size
-    if (isAmino){for (auto table: kmer_tableAmino){max += table.size();}} // use the sum of amino table sizes
-    else {for (auto table: kmer_table){max+=table.size();}} // use the sum of base table sizes
+    if (isAmino){for (auto& table: kmer_tableAmino){max += table.size();}} // use the sum of amino table sizes
+    else {for (auto& table: kmer_table){max+=table.size();}} // use the sum of base table sizes
 
     // If the tables are empty, there is nothing to be done	    
     if (max==0){
         return;
     }
     // The iterators for the tables
-    hash_map<kmer_t, color_t>::iterator base_it;
-    hash_map<kmerAmino_t, color_t>::iterator amino_it;
+    hash_map<kmer_t, kmer_color_t>::iterator base_it;
+    hash_map<kmerAmino_t, kmer_color_t>::iterator amino_it;
 
     // Iterate the tables
     for (int i = 0; i < graph::table_count; i++) // Iterate all tables
@@ -1236,7 +2256,7 @@ void graph::output_core(ostream& file, bool& verbose)
                 prog = next; cur++;
             }
             // update the iterator
-            color_t* color_ref; // reference of the current color
+            kmer_color_t* color_ref; // reference of the current color
             kmer_t kmer;
 			kmerAmino_t kmerAmino;
             if (isAmino) { // if the amino table is used, update the amino iterator
@@ -1249,7 +2269,7 @@ void graph::output_core(ostream& file, bool& verbose)
                 else {kmer = base_it.key(); color_ref = &base_it.value(); ++base_it;} // iterate the base table
             }
             // process
-            color_t& color = *color_ref;
+            color_t color = *color_ref;
 			all_count++;
 			// is core?
 			if(color::is_complete(color)){
@@ -1275,13 +2295,13 @@ void graph::output_core(ostream& file, bool& verbose)
  * @return number of k-mers in all tables.
  */
 uint64_t graph::number_kmers(){
-	uint64_t num=0;
+	uint64_t num=frozen_count; // the frozen k-mers
 	if (isAmino){ // use the sum of amino table sizes
-		for (auto table: kmer_tableAmino){num += table.size();}
+		for (auto& table: kmer_tableAmino){num += table.size();}
 	} else { // use the sum of base table sizeskmer_table.size(); 
-		for (auto table: kmer_table){num+=table.size();}
+		for (auto& table: kmer_table){num+=table.size();}
 	}
-	return num;
+	return num + sorted_kmer_count; // plus the k-mers counted by sorting
 }
 
 
@@ -1341,7 +2361,7 @@ double graph::stdev_number_kmers(double mu, int n){
  * @param mean weight function
  * @return the new list of splits of length at least t ordered by weight as usual
  */
-multimap_<double, color_t> graph::bootstrap(double mean(uint32_t&, uint32_t&)) {
+multimap_<double, color_t> graph::bootstrap(double mean(uint64_t&, uint64_t&)) {
 
 	uint64_t max = graph::number_kmers();
 
@@ -1349,13 +2369,13 @@ multimap_<double, color_t> graph::bootstrap(double mean(uint32_t&, uint32_t&)) {
 	std::mt19937 gen(rd());
 
 	multimap_<double, color_t> sl;
-	double min_value=0;
+	top_splits top(t, 0);
 
 	// perform n time max trials, each succeeds 1/max
 	std::binomial_distribution<> d(max, 1.0/max);
 	
 	// Iterating over the map using Iterator till map end.
-	hash_map<color_t, array<uint32_t,2>>::iterator it = color_table.begin();
+	hash_map<split_color_t, array<uint32_t,2>>::iterator it = color_table.begin();
 	while (it != color_table.end())	{
 
 		// Accessing the key
@@ -1365,7 +2385,7 @@ multimap_<double, color_t> graph::bootstrap(double mean(uint32_t&, uint32_t&)) {
 		array<uint32_t,2> weights = it->second;
 		
 		// bootstrap the number of kmer occurrences for split and inverse
-		array<uint32_t,2> new_weights;
+		array<uint64_t,2> new_weights;    // in 64 bits, the scaled weights may exceed 32 bits
 		new_weights[0]=0;
 		new_weights[1]=0;
 		for (int i=0;i<2;i++) {
@@ -1375,23 +2395,20 @@ multimap_<double, color_t> graph::bootstrap(double mean(uint32_t&, uint32_t&)) {
 // 			uint64_t n = weights[i]*max;
 // 			std::binomial_distribution<> dn(n, 1.0/max);
 // 			cout << weights[i] << "\t" << dn(gen) << "\t" << new_weights[i] << "\n" << flush;
+			new_weights[i] *= scaled;    // estimate the weights of all k-mers from the FracMinHash sample
 		}
 		
 		//insert into new split list
-		double new_mean = mean(new_weights[0], new_weights[1]);    // calculate the new mean value
-		if (new_mean >= min_value) {    // if it is greater than the min. value, add it to the top list
-			sl.emplace(new_mean, colors);    // insert it at the correct position ordered by weight
-			if (sl.size() > t) {
-				sl.erase(--sl.end());    // if the top list exceeds its limit, erase the last entry
-				min_value = sl.rbegin()->first;    // update the min. value for the next iteration (only necessary of t is exceeded, otherwise min_value does not play a role.
-			}
-		}
+		top.add(mean(new_weights[0], new_weights[1]), colors);    // calculate the new mean value
 		
 		// iterator incremented to point next item
 		it++;
 		
 	}
 
+	// insert the sorted splits at the end of the list
+	top.finish();
+	for (auto& split : top.splits) sl.emplace_hint(sl.end(), split);
 	return sl;
 }
 
@@ -7,6 +7,8 @@
 
 #include <thread>
 #include <atomic>
+#include <mutex>
+#include <memory>
 
 #include <iomanip>
 #include <string>
@@ -23,12 +25,26 @@
 
 using namespace std;
 
+/**
+ * A mixing hash function (xor-shift-multiply on top of std::hash).
+ * Instances with different seeds are independent, so the hashing inside a table does not correlate with the bin selection.
+ */
+template <typename K, uint64_t seed = 0x9e3779b97f4a7c15u>
+  struct mix_hash {
+      uint64_t operator()(const K& key) const noexcept {
+          uint64_t x = std::hash<K>()(key) ^ seed;
+          x ^= x >> 32; x *= 0xd6e8feb86659fd93u;
+          x ^= x >> 32; x *= 0xd6e8feb86659fd93u;
+          return x ^ (x >> 32);
+      }
+  };
+
 template <typename K, typename V>
     // using hash_map = unordered_map<K,V>;
-    using hash_map = tsl::sparse_pg_map<K,V>;
+    using hash_map = tsl::sparse_pg_map<K,V,mix_hash<K>>;
 template <typename T>
     // using hash_set = unordered_set<T>;
-    using hash_set = tsl::sparse_pg_set<T>;
+    using hash_set = tsl::sparse_pg_set<T,mix_hash<T>>;
 
 //stable sorting of split weights
 template <typename K, typename V>
@@ -40,6 +56,37 @@ template <typename K, typename V>
 template <typename K, typename V>
   using multimap_ = set<pair<K,V>, compare<K,V>>;
 
+/**
+ * A count-min sketch with conservative update and 8-bit saturating counters.
+ * An estimate never falls below the true number of occurrences of a key.
+ */
+template <typename K>
+struct count_sketch {
+  static constexpr uint_fast32_t depth = 4;
+  vector<uint8_t> counters;    // depth rows of width counters each
+  uint64_t mask = 0;    // width-1, the width is a power of two
+
+  void reset(const uint64_t& width) {
+    if (width == mask+1) fill(counters.begin(), counters.end(), 0);
+    else {counters.assign(depth*width, 0); mask = width-1;}
+  }
+
+  uint_fast8_t add(const K& key) {
+    uint64_t h = mix_hash<K, 0x6a09e667f3bcc909u>()(key);
+    uint64_t step = (h >> 32) | 1;    // double hashing for the rows
+    uint8_t* cell[depth];
+    uint_fast8_t min = 255;
+    for (uint_fast32_t d = 0; d < depth; ++d, h += step) {
+      cell[d] = &counters[d*(mask+1) + (h & mask)];
+      if (*cell[d] < min) min = *cell[d];
+    }
+    if (min == 255) return min;    // saturated
+    ++min;
+    for (uint_fast32_t d = 0; d < depth; ++d) if (*cell[d] < min) *cell[d] = min;    // only raise the minimal counters
+    return min;
+  }
+};
+
 
 
 #include "kmer.h"
@@ -51,6 +98,32 @@ template <typename K, typename V>
   
 #pragma once
 
+/**
+ * These are the color sets stored per k-mer and per split in the color table: dense bitsets for few genomes, adaptive sets for many.
+ */
+#if maxN > 128
+    typedef color_set kmer_color_t;
+    typedef color_set split_color_t;
+#else
+    typedef color_t kmer_color_t;
+    typedef color_t split_color_t;
+#endif
+
+/**
+ * This function adds a color to a stored color set while its bin is only locked shared.
+ * @param colors the stored color set
+ * @param color the color to add
+ * @param added set to true, if the color has been added
+ * @return false, if the set has to be changed under the exclusive lock
+ */
+inline bool set_shared(color_t& colors, const uint16_t& color, bool& added) {
+    added = !colors.test_and_set(color);    // atomic fetch-or on the word containing the color bit
+    return true;
+}
+inline bool set_shared(color_set& colors, const uint16_t& color, bool& added) {
+    return colors.set_shared(color, added);
+}
+
 /**
  * A tree structure that is needed for generating a NEWICK string.
  */
@@ -60,6 +133,27 @@ struct node {
     vector<node*> subsets;
 };
 
+/**
+ * A k-mer paired with the color of the genome it was read from (the unit of sort-based counting).
+ */
+template <typename K>
+struct colored_kmer {
+    K kmer;
+    uint16_t color;
+};
+
+/**
+ * The compile-time configuration of the path a k-mer takes into the tables (see graph::select_pipeline).
+ */
+template <bool amino_, bool blacklisted_, uint_fast8_t q_mode_, bool q_per_genome_, bool count_kmers_>
+struct emplace_policy {
+    static constexpr bool amino = amino_;    // amino acid instead of nucleotide k-mers
+    static constexpr bool blacklisted = blacklisted_;    // skip k-mers contained in the blacklist
+    static constexpr uint_fast8_t q_mode = q_mode_;    // 0: counted up to q and forwarded once per file, 1: no coverage check, 2: seen twice, 3: counted up to q, 4: estimated up to q and forwarded once per file, 5: counted up to q and forwarded once per genome
+    static constexpr bool q_per_genome = q_per_genome_;    // coverage thresholds given per genome by the q_table
+    static constexpr bool count_kmers = count_kmers_;    // count the k-mers per genome
+};
+
 /**
 * A spinlock implementation
 * source: https://rigtorp.se/spinlock/
@@ -98,6 +192,294 @@ struct spinlock {
   }
 };
 
+/**
+* A shared spinlock: many readers or one (preferred) writer.
+* Readers only wait for writers, never for each other.
+*/
+struct shared_spinlock {
+  static constexpr uint32_t writer = 1u << 31;
+  atomic<uint32_t> state_ = {0};
+
+  void lock() noexcept {
+    // Claim the writer bit, then wait for the readers to leave
+    while (state_.fetch_or(writer, std::memory_order_acquire) & writer) {
+      while (state_.load(std::memory_order_relaxed) & writer) pause();
+    }
+    while (state_.load(std::memory_order_acquire) != writer) pause();
+  }
+
+  void unlock() noexcept {
+    state_.fetch_sub(writer, std::memory_order_release);
+  }
+
+  void lock_shared() noexcept {
+    for (;;) {
+      // Optimistically enter, back off if a writer holds or waits for the lock
+      if (!(state_.fetch_add(1, std::memory_order_acquire) & writer)) {
+        return;
+      }
+      state_.fetch_sub(1, std::memory_order_relaxed);
+      while (state_.load(std::memory_order_relaxed) & writer) pause();
+    }
+  }
+
+  void unlock_shared() noexcept {
+    state_.fetch_sub(1, std::memory_order_release);
+  }
+
+  static void pause() noexcept {
+    #if defined(__i386__) || defined(__x86_64__)
+      __builtin_ia32_pause();
+    #else
+      std::this_thread::yield();
+    #endif
+  }
+};
+
+
+
+/**
+ * The saturating 8-bit occurrence counters of one genome's k-mers, shared by all threads reading its files.
+ * The counters are striped over independently locked tables, so concurrent updates rarely wait.
+ */
+template <typename K>
+struct genome_counter {
+  static constexpr uint_fast32_t stripe_count = 256;
+  hash_map<K, uint8_t> stripe[stripe_count];
+  spinlock lock[stripe_count];
+
+  /**
+   * Counts an occurrence of the key, true exactly once: when its count reaches the threshold (at most 255).
+   */
+  bool add(const K& key, const uint_fast8_t& threshold) {
+    uint_fast32_t s = mix_hash<K, 0xbb67ae8584caa73bu>()(key) >> 56;    // independent of the hashing inside the stripes
+    lock[s].lock();
+    uint8_t& count = stripe[s][key];
+    bool reached = count < threshold && ++count == threshold;    // saturates at the threshold
+    lock[s].unlock();
+    return reached;
+  }
+};
+
+/**
+ * A set of k-mers striped over independently locked tables, so several threads can fill it at once.
+ * Look-ups are not locked, they are only safe once the set is filled.
+ */
+template <typename K>
+struct striped_set {
+  static constexpr uint_fast32_t stripe_count = 256;
+  hash_set<K> stripe[stripe_count];
+  spinlock lock[stripe_count];
+
+  static inline uint_fast32_t stripe_of(const K& key) {
+    return mix_hash<K, 0x5be0cd19137e2179u>()(key) >> 56;    // independent of the hashing inside the stripes
+  }
+
+  void add(const K& key) {
+    uint_fast32_t s = stripe_of(key);
+    lock[s].lock();
+    stripe[s].emplace(key);
+    lock[s].unlock();
+  }
+
+  bool contains(const K& key) const {
+    const hash_set<K>& set = stripe[stripe_of(key)];
+    return set.find(key) != set.end();
+  }
+
+  uint64_t size() const {
+    uint64_t size = 0;
+    for (auto& set : stripe) size += set.size();
+    return size;
+  }
+};
+
+/**
+ * The rolling minimum over the s-mers of a k-mer, each s-mer canonical (if reverse) and ordered by hash.
+ * A monotone queue keeps the candidates for the minimum, so each base costs O(1).
+ * It decides the syncmers and the bins of super-k-mers.
+ */
+struct smer_window {
+  uint64_t s = 0, k = 0, w = 0;    // s-mer length, k-mer length, s-mers per k-mer
+  bool reverse = true;
+  uint64_t mask = 0, cap = 1;    // s-mer bits, ring capacity (a power of two, at least w)
+  vector<uint64_t> hash;    // the hashes of the last s-mers, by their index in the current word
+  vector<uint64_t> queue;    // the indices of the candidates for the window minimum, ascending by hash
+  uint64_t smer = 0, rcsmer = 0, count = 0, head = 0, tail = 0;
+  uint64_t min = 0;    // the smallest s-mer hash of the current k-mer
+
+  void init(const uint64_t& s_, const uint64_t& k_, const bool& reverse_) {
+    s = s_; k = k_; w = k-s+1; reverse = reverse_;
+    mask = s == 32 ? ~0ull : (1ull << 2*s) - 1;
+    while (cap < w) cap <<= 1;
+    hash.assign(cap, 0); queue.assign(cap, 0);
+  }
+
+  void reset() {count = head = tail = 0;}
+
+  /**
+   * Shifts in the next base, true once the word holds a complete k-mer (then min is set).
+   */
+  bool shift(const uint_fast8_t& right) {
+    count++;
+    smer = ((smer << 2) | right) & mask;
+    rcsmer = (rcsmer >> 2) | ((uint64_t) (0b11u ^ right) << (2*s-2));
+    if (count < s) return false;
+    uint64_t i = count-s;    // the index of the current s-mer in the word
+    uint64_t h = mix_hash<uint64_t, 0x9b05688c2b3e6c1fu>()(reverse && rcsmer < smer ? rcsmer : smer);
+    hash[i & (cap-1)] = h;
+    if (head != tail && queue[head & (cap-1)] + w <= i) head++;    // the minimum left the k-mer
+    while (tail != head && hash[queue[(tail-1) & (cap-1)] & (cap-1)] > h) tail--;
+    queue[tail++ & (cap-1)] = i;
+    if (count < k) return false;
+    min = hash[queue[head & (cap-1)] & (cap-1)];
+    return true;
+  }
+
+  /**
+   * True if the smallest s-mer of the current k-mer is at its start or end.
+   */
+  bool closed_syncmer() const {
+    uint64_t first = count-k;    // the index of the first s-mer of the k-mer
+    return hash[first & (cap-1)] == min || hash[(first+w-1) & (cap-1)] == min;
+  }
+
+  /**
+   * True if the smallest s-mer of the current k-mer is in its middle (both middles for an even number of s-mers).
+   */
+  bool open_syncmer() const {
+    uint64_t first = count-k;
+    return hash[(first + (w-1)/2) & (cap-1)] == min || hash[(first + w/2) & (cap-1)] == min;
+  }
+};
+
+/**
+ * A read-only blacklist: the sorted k-mers with a Bloom filter in front, both memory-mapped from an index file.
+ * Most k-mers are not blacklisted and are rejected by the filter without touching the sorted array.
+ */
+template <typename K>
+struct blacklist_index {
+  static constexpr uint64_t hashes = 7;    // the number of filter bits per k-mer
+  static constexpr uint64_t seed = 0x1f83d9abfb41bd6bu;    // independent of the FracMinHash sample (scaled_seed)
+  const uint64_t* bloom = nullptr; uint64_t mask = 0;    // the filter (null if there is no index), the number of its bits minus one
+  const K* kmers = nullptr; uint64_t size = 0;    // the sorted k-mers
+
+  /**
+   * Returns the i-th filter bit of a hash (double hashing).
+   */
+  uint64_t position(const uint64_t& hash, const uint64_t& i) const {
+    return (hash + i * (hash >> 32 | 1)) & mask;
+  }
+
+  /**
+   * Sets the filter bits of a k-mer, while the index is built.
+   */
+  void insert(vector<uint64_t>& bits, const K& kmer) const {
+    uint64_t hash = mix_hash<K, seed>()(kmer);
+    for (uint64_t i = 0; i < hashes; ++i) {
+      uint64_t p = position(hash, i);
+      bits[p >> 6] |= 1ull << (p & 63);
+    }
+  }
+
+  bool contains(const K& kmer) const {
+    uint64_t hash = mix_hash<K, seed>()(kmer);
+    for (uint64_t i = 0; i < hashes; ++i) {
+      uint64_t p = position(hash, i);
+      if (!(bloom[p >> 6] >> (p & 63) & 1)) return false;    // certainly not blacklisted
+    }
+    return binary_search(kmers, kmers + size, kmer);
+  }
+};
+
+/**
+ * The resolutions of an ambiguous (IUPAC) word into plain k-mers, for nucleotides with their rolling reverse complements.
+ * They are enumerated with the oldest position outermost, so the position leaving the word keeps a prefix of them,
+ * and two buffers alternate between the positions: once grown, nothing is allocated or rebuilt per character.
+ */
+template <bool amino>
+struct iupac_window {
+  using K = typename conditional<amino, kmerAmino_t, kmer_t>::type;
+  uint64_t k = 0;
+  uint8_t factor[256] = {};    // the multiplicity of each character, as counted against the limit (0: not an IUPAC character)
+  uint8_t options[256] = {};    // the number of resolutions of each character
+  char option[256][23] = {};    // the resolutions of each character (nucleotides: their 2-bit codes)
+  vector<K> kmers[2], rcmers[2];    // the double-buffered resolutions of the current word and their reverse complements
+  bool ball = false; uint64_t size = 1;    // the current buffer, the number of resolutions (0 after an unknown character)
+  vector<uint8_t> choices; uint64_t shifted = 0;    // the ring of resolution numbers per position, the positions shifted in
+  vector<uint8_t> factors; uint64_t counted = 0;    // the ring of multiplicities of the last k characters, the characters counted
+  long double product = 1;    // the overall multiplicity of the last k characters
+
+  void init(const uint64_t& k_) {
+    k = k_;
+    choices.assign(k, 0); factors.assign(k, 0);
+    auto resolve = [&] (char c, const string& resolutions, uint8_t multiplicity) {
+      factor[(uint8_t) c] = multiplicity; options[(uint8_t) c] = resolutions.length();
+      for (uint64_t j = 0; j < resolutions.length(); ++j)
+        option[(uint8_t) c][j] = amino ? resolutions[j] : util::char_to_bits(resolutions[j]);
+    };
+    if (!amino) {
+      for (string base : {"A", "C", "G", "T"}) resolve(base[0], base, 1);
+      resolve('R', "AG", 2); resolve('Y', "CT", 2); resolve('S', "CG", 2);
+      resolve('W', "AT", 2); resolve('K', "GT", 2); resolve('M', "AC", 2);
+      resolve('B', "CGT", 3); resolve('D', "AGT", 3); resolve('H', "ACT", 3); resolve('V', "ACG", 3);
+      resolve('N', "ACGT", 4);
+    } else {
+      string acids = "ACDEFGHIKLMNOPQRSTUVWY*";
+      for (char acid : acids) resolve(acid, string(1, acid), 1);
+      resolve('B', "DN", 2); resolve('Z', "EQ", 2); resolve('J', "LI", 2);
+      resolve('X', acids, 22);    // counted as 22, resolved to all
+    }
+    reset();
+  }
+
+  void reset() {
+    if (kmers[ball].empty()) {kmers[ball].resize(1); if (!amino) rcmers[ball].resize(1);}
+    kmers[ball][0] = K(); if (!amino) rcmers[ball][0] = K();
+    size = 1; shifted = counted = 0; product = 1;
+  }
+
+  /**
+   * Counts the multiplicity of the next character, the one leaving the last k characters is divided out.
+   */
+  void count(const char& c) {
+    uint8_t f = factor[(uint8_t) c];
+    if (f == 0) return;    // unknown characters are not counted
+    product *= f;
+    if (counted >= k) product /= factors[counted % k];
+    factors[counted++ % k] = f;
+  }
+
+  /**
+   * Shifts the next character into all resolutions of the word.
+   */
+  void shift(const char& c) {
+    if (size == 0) return;    // an unknown character, nothing is left until the next reset
+    if (shifted >= k) size /= choices[shifted % k];    // the oldest position leaves, the resolutions of its first option remain
+    uint8_t f = options[(uint8_t) c];
+    if (f == 0) {size = 0; return;}
+    choices[shifted++ % k] = f;
+    vector<K>& prev = kmers[ball]; vector<K>& next = kmers[!ball];
+    if (next.size() < size*f) {next.resize(size*f); if (!amino) rcmers[!ball].resize(size*f);}
+    for (uint64_t i = 0; i < size; ++i) {
+      for (uint64_t j = 0; j < f; ++j) {
+        K kmer = prev[i];
+        if constexpr (amino) {
+          char acid = option[(uint8_t) c][j];
+          kmerAmino::shift_right(kmer, acid);
+        } else {
+          uint8_t right = option[(uint8_t) c][j];
+          K rcmer = rcmers[ball][i];
+          kmer::shift(kmer, right);
+          kmer::shift_reverse(rcmer, right);
+          rcmers[!ball][i*f+j] = rcmer;
+        }
+        next[i*f+j] = kmer;
+      }
+    }
+    ball = !ball; size *= f;
+  }
+};
 
 
 /**
@@ -121,10 +503,79 @@ private:
     static bool isAmino;
     
 	/**
-	* Look-up set for k-mers that are ignored, i.e., not stored, counted etc.
+	* Look-up set for k-mers that are ignored, i.e., not stored, counted etc., striped so it can be filled in parallel.
+	*/
+	static striped_set<kmer_t> blacklist;
+	static striped_set<kmerAmino_t> blacklist_amino;
+
+	/**
+	* This indicates that the blacklist is used while inserting k-mers.
 	*/
-	static hash_set<kmer_t> blacklist;
-	static hash_set<kmerAmino_t> blacklist_amino;	
+	static bool blacklisted;
+
+	/**
+	 * This is the memory-mapped blacklist index, used instead of the look-up sets if one is given.
+	 */
+	static blacklist_index<kmer_t> blacklist_mapped;
+	static blacklist_index<kmerAmino_t> blacklist_mappedAmino;
+
+	/**
+	 * This function tells if a k-mer is blacklisted.
+	 */
+	static inline bool in_blacklist(const kmer_t& kmer) {
+		return blacklist_mapped.bloom ? blacklist_mapped.contains(kmer) : blacklist.contains(kmer);
+	}
+	static inline bool in_blacklist_amino(const kmerAmino_t& kmer) {
+		return blacklist_mappedAmino.bloom ? blacklist_mappedAmino.contains(kmer) : blacklist_amino.contains(kmer);
+	}
+
+	/**
+	* This indicates that the k-mers are counted per genome.
+	*/
+	static bool counting;
+
+	/**
+	* This indicates that each k-mer is forwarded to the tables only once per input file.
+	*/
+	static bool deduplicating;
+
+	/**
+	* This indicates that the occurrences are estimated by a count-min sketch per thread before a k-mer is kept (q > 1).
+	*/
+	static bool sketching;
+
+	/**
+	* These are the per-thread count-min sketches, reset for each input file.
+	*/
+	static vector<count_sketch<kmer_t>> quality_sketch;
+	static vector<count_sketch<kmerAmino_t>> quality_sketchAmino;
+
+	/**
+	* This is the maximum width of a sketch row, such that the sketches of all threads fit the budget (at most 2^28 counters).
+	*/
+	static uint64_t sketch_width;
+
+	/**
+	* This indicates that the occurrences are counted per genome across all of its files, by counters shared among the threads (q > 1).
+	*/
+	static bool genome_counting;
+
+	/**
+	* These are the shared counters of the genomes currently read, allocated by the first and released after the last file of a genome.
+	*/
+	static vector<unique_ptr<genome_counter<kmer_t>>> genome_counts;
+	static vector<unique_ptr<genome_counter<kmerAmino_t>>> genome_countsAmino;
+
+	/**
+	* This is the number of files per genome that have not been read completely yet.
+	*/
+	static vector<uint32_t> genome_files;
+	static mutex genome_mutex;
+
+	/**
+	* This marks a k-mer in the per-thread quality map that has already been forwarded to the tables.
+	*/
+	static constexpr uint16_t forwarded = numeric_limits<uint16_t>::max();
 	
     /**
      * This int indicates the number of tables to use for hashing
@@ -132,23 +583,30 @@ private:
     static uint64_t table_count;
     
     /**
-     * This vector holds the carries of 2**i % table_count for fast distribution of bitset represented kmers
+     * This is the seed of the hash function selecting the bin of a k-mer (independent of the hashing inside the tables).
      */
-    static vector<uint_fast32_t> period;
+    static constexpr uint64_t bin_seed = 0x2545f4914f6cdd1du;
+
     /**
      * This is a vector of hash tables mapping k-mers to colors [O(1)].
      */
-    static vector<hash_map<kmer_t, color_t>> kmer_table;
+    static vector<hash_map<kmer_t, kmer_color_t>> kmer_table;
 
     /**
-     * This is a vector of spinlocks protecting the hash tables.
+     * This is a vector of shared spinlocks protecting the hash tables.
      */
-    static vector<spinlock> lock;
+    static vector<shared_spinlock> lock;
+
+    /**
+     * This is the number of k-mers whose bins are prefetched ahead of their insertion (power of two),
+     * their buckets are prefetched halfway through.
+     */
+    static constexpr uint_fast32_t lookahead = 16;
 
     /**
      * This is a hash table mapping k-mers to colors [O(1)].
      */
-    static vector<hash_map<kmerAmino_t, color_t>> kmer_tableAmino;
+    static vector<hash_map<kmerAmino_t, kmer_color_t>> kmer_tableAmino;
 
 
     /**
@@ -174,6 +632,92 @@ private:
     static vector<hash_map<kmer_t, uint16_t>> quality_map;
     static vector<hash_map<kmerAmino_t, uint16_t>> quality_mapAmino;
 
+    /**
+     * This indicates that k-mers are counted by sorting buffered (k-mer, color) pairs instead of using the hash tables.
+     */
+    static bool sorting;
+
+    /**
+     * This indicates that the coverage threshold is applied while reducing the sorted pairs, all occurrences are buffered (q > 1).
+     */
+    static bool sort_counting;
+
+    /**
+     * This is the number of partitions the buffered pairs are split into by their bin, each one is sorted on its own.
+     * It is 256, or more if the partitions of the threads would not fit the memory limit at once.
+     */
+    static uint_fast32_t partition_count;
+
+    /**
+     * These are the per-thread buffers of (k-mer, color) pairs, one for each partition.
+     */
+    static vector<vector<vector<colored_kmer<kmer_t>>>> kmer_buffer;
+    static vector<vector<vector<colored_kmer<kmerAmino_t>>>> kmer_bufferAmino;
+
+    /**
+     * This is the number of non-singleton k-mers reduced from the sorted buffers.
+     */
+    static uint64_t sorted_kmer_count;
+
+    /**
+     * These are the core k-mers collected while reducing the sorted buffers (if requested).
+     */
+    static vector<kmer_t> core_kmers;
+    static vector<kmerAmino_t> core_kmersAmino;
+
+    /**
+     * This indicates that the k-mer tables have been frozen into the sorted arrays below.
+     */
+    static bool frozen;
+
+    /**
+     * These are the frozen k-mers, sorted within each bin, and the color class of each one.
+     */
+    static vector<kmer_t> frozen_kmers;
+    static vector<kmerAmino_t> frozen_kmersAmino;
+    static vector<uint32_t> frozen_classes;
+
+    /**
+     * This is the number of frozen (or consumed) k-mers.
+     */
+    static uint64_t frozen_count;
+
+    /**
+     * This is the start of each bin in the frozen arrays (plus the end of the last bin).
+     */
+    static vector<uint64_t> frozen_offsets;
+
+    /**
+     * These are the distinct color sets of the frozen k-mers (color classes) and their numbers of k-mers.
+     */
+    static vector<color_t> color_classes;
+    static vector<uint64_t> class_sizes;
+
+    /**
+     * This is the directory the partitions are spilled to when the memory is limited (empty if not).
+     */
+    static string bucket_dir;
+
+    /**
+     * This is the number of buffered pairs after which a thread spills its buffers to disk (0 if unlimited).
+     */
+    static uint64_t spill_size;
+
+    /**
+     * These are the numbers of pairs currently buffered per thread (strided by a cache line).
+     */
+    static vector<uint64_t> buffered;
+
+    /**
+     * These are the mutexes guarding the appends to the spilled partitions.
+     */
+    static vector<mutex> bucket_mutex;
+
+    /**
+     * This is the number of bytes the buffers and the partitions being reduced may use (0 if unlimited).
+     */
+    static uint64_t memory_budget;
+
 public:
 
 	/**
@@ -181,7 +725,7 @@ public:
 	* @param mean weight function
 	* @return the new list of splits of length at least t ordered by weight as usual
 	*/
-	static multimap_<double, color_t> bootstrap(double mean(uint32_t&, uint32_t&));
+	static multimap_<double, color_t> bootstrap(double mean(uint64_t&, uint64_t&));
 
     /**
      * This is an ordered tree collecting the splits [O(log n)].
@@ -191,7 +735,7 @@ public:
     /**
      * This is a hash table mapping colors to weights [O(1)].
      */
-    static hash_map<color_t, array<uint32_t,2>> color_table;
+    static hash_map<split_color_t, array<uint32_t,2>> color_table;
 
 	/**
     * These are the allowed chars.
@@ -224,22 +768,11 @@ public:
             
 
             // Init base tables
-            kmer_table = vector<hash_map<kmer_t, color_t>> (table_count);
+            kmer_table = vector<hash_map<kmer_t, kmer_color_t>> (table_count);
             singleton_kmer_table = vector<hash_map<kmer_t, uint16_t>> (table_count);
 
             // Init the lock vector
-            lock = vector<spinlock> (table_count);
-
-            // Precompute the period for fast shift update kmer binning in bitset representation 
-            #if (maxK > 32)     
-            uint_fast32_t last = 1 % table_count;
-            for (int i = 1; i <= 2*(kmer::k); i++)
-            {
-                // cout << last << endl;
-                period.push_back(last);
-                last = (2 * last) % table_count;
-            }
-            #endif
+            lock = vector<shared_spinlock> (table_count);
 
             graph::allowedChars.push_back('A');
             graph::allowedChars.push_back('C');
@@ -252,21 +785,11 @@ public:
             table_count = (0b1u << 14) + 1;
 
             // Init amino tables
-            kmer_tableAmino = vector<hash_map<kmerAmino_t, color_t>> (table_count);
+            kmer_tableAmino = vector<hash_map<kmerAmino_t, kmer_color_t>> (table_count);
             singleton_kmer_tableAmino = vector<hash_map<kmerAmino_t, uint16_t>> (table_count);
             
             // Init the mutex lock vector
-            lock = vector<spinlock> (table_count);
-
-            // Precompute the period for fast shift update kmer binning in bitset representation 
-            #if (maxK > 12)     
-            uint64_t last = 1 % table_count;
-            for (int i = 1; i <= 5*(kmerAmino::k); i++)
-            {
-                period.push_back(last);
-                last = (2 * last) % table_count;
-            }
-            #endif
+            lock = vector<shared_spinlock> (table_count);
 
             graph::allowedChars.push_back('A');
             //graph::allowedChars.push_back('B');
@@ -297,109 +820,10 @@ public:
             graph::allowedChars.push_back('*');
         }
 
-        graph::quality = quality;
-        graph::q_table = q_table;
-        graph::blacklist = blacklist;
-        graph::blacklist_amino = blacklist_amino;
-        switch (quality) {
-        case 1:
-        case 0: /* no quality check */
-            emplace_kmer_tmp = [&] (const uint64_t& T, uint_fast32_t& bin, const kmer_t& kmer, const uint16_t& color) {
-                hash_kmer<count_kmers>(bin, kmer, color);
-            };
-            emplace_kmer_amino_tmp = [&] (const uint64_t& T, uint_fast32_t& bin, const kmerAmino_t& kmer, const uint16_t& color) {
-                hash_kmer_amino<count_kmers>(bin, kmer, color);
-            };
-            break;
-
-        case 2:
-            isAmino ? quality_setAmino.resize(thread_count) : quality_set.resize(thread_count);
-            if (q_table.size()>0){
-                emplace_kmer_tmp = [&] (const uint64_t& T, uint_fast32_t& bin, const kmer_t& kmer, const uint16_t& color) {
-                    if (q_table[color]==1){
-                        hash_kmer<count_kmers>(bin, kmer, color);
-                    } else if (quality_set[T].find(kmer) == quality_set[T].end()) {
-                        quality_set[T].emplace(kmer);
-                    } else {
-                        quality_set[T].erase(kmer);
-                        hash_kmer<count_kmers>(bin, kmer, color);
-                    }
-                };
-                emplace_kmer_amino_tmp = [&] (const uint64_t& T, uint_fast32_t& bin, const kmerAmino_t& kmer, const uint16_t& color) {
-                    if (q_table[color]==1){
-                        hash_kmer_amino<count_kmers>(bin, kmer, color);
-                    } else if (quality_setAmino[T].find(kmer) == quality_setAmino[T].end()) {
-                        quality_setAmino[T].emplace(kmer);
-                    } else {
-                        quality_setAmino[T].erase(kmer);
-                        hash_kmer_amino<count_kmers>(bin, kmer, color);
-                    }
-                };
-            } else { // global quality value (one if-clause fewer)
-                emplace_kmer_tmp = [&] (const uint64_t& T, uint_fast32_t& bin, const kmer_t& kmer, const uint16_t& color) {
-                    if (quality_set[T].find(kmer) == quality_set[T].end()) {
-                        quality_set[T].emplace(kmer);
-                    } else {
-                        quality_set[T].erase(kmer);
-                        hash_kmer<count_kmers>(bin, kmer, color);
-                    }
-                };
-                emplace_kmer_amino_tmp = [&] (const uint64_t& T, uint_fast32_t& bin, const kmerAmino_t& kmer, const uint16_t& color) {
-                    if (quality_setAmino[T].find(kmer) == quality_setAmino[T].end()) {
-                        quality_setAmino[T].emplace(kmer);
-                    } else {
-                        quality_setAmino[T].erase(kmer);
-                        hash_kmer_amino<count_kmers>(bin, kmer, color);
-                    }
-                };
-            }
-            break;
-        default:
-            isAmino ? quality_mapAmino.resize(thread_count) : quality_map.resize(thread_count);
-            if (q_table.size()>0){
-                emplace_kmer_tmp = [&] (const uint64_t& T, uint_fast32_t& bin, const kmer_t& kmer, const uint16_t& color) {
-                    if (quality_map[T][kmer] < q_table[color]-1) {
-                        quality_map[T][kmer]++;
-                    } else {
-                        quality_map[T].erase(kmer);
-                        hash_kmer<count_kmers>(bin, kmer, color);
-                    }
-                };
-                emplace_kmer_amino_tmp = [&] (const uint64_t& T, uint_fast32_t& bin, const kmerAmino_t& kmer, const uint16_t& color) {
-                    if (quality_mapAmino[T][kmer] < q_table[color]-1) {
-                        quality_mapAmino[T][kmer]++;
-                    } else {
-                        quality_mapAmino[T].erase(kmer);
-                        hash_kmer_amino<count_kmers>(bin, kmer, color);
-                    }
-                };
-            }else { // global quality value
-                emplace_kmer_tmp = [&] (const uint64_t& T, uint_fast32_t& bin, const kmer_t& kmer, const uint16_t& color) {
-                    if (quality_map[T][kmer] < quality-1) {
-                        quality_map[T][kmer]++;
-                    } else {
-                        quality_map[T].erase(kmer);
-                        hash_kmer<count_kmers>(bin, kmer, color);
-                    }
-                };
-                emplace_kmer_amino_tmp = [&] (const uint64_t& T, uint_fast32_t& bin, const kmerAmino_t& kmer, const uint16_t& color) {
-                    if (quality_mapAmino[T][kmer] < quality-1) {
-                        quality_mapAmino[T][kmer]++;
-                    } else {
-                        quality_mapAmino[T].erase(kmer);
-                        hash_kmer_amino<count_kmers>(bin, kmer, color);
-                    }
-                };
-
-            }
-            break;
-        }
-        emplace_kmer = [&] (const uint64_t& T, uint_fast32_t& bin, const kmer_t& kmer, const uint16_t& color) {
-            emplace_kmer_tmp(T, bin, kmer, color);
-        };
-        emplace_kmer_amino = [&] (const uint64_t& T, uint_fast32_t& bin, const kmerAmino_t& kmer, const uint16_t& color) {
-            emplace_kmer_amino_tmp(T, bin, kmer, color);
-        };
+        for (auto& kmer : blacklist) graph::blacklist.add(kmer);
+        for (auto& kmer : blacklist_amino) graph::blacklist_amino.add(kmer);
+        counting = count_kmers;
+        set_quality(q_table, quality, thread_count);
     }
 
     static void init_count(uint64_t& top_size, bool amino, vector<int>& q_table, int& quality, hash_set<kmer_t>& blacklist, hash_set<kmerAmino_t>& blacklist_amino, uint64_t& thread_count) {
@@ -416,58 +840,230 @@ public:
     */
     
     /**
-     * This function shift updates the bin of a kmer
-    */
-    static uint_fast32_t shift_update_bin(uint_fast32_t& bin, uint_fast8_t& left, uint_fast8_t& right);
-    
+     * This method computes the bin of a given kmer from a mixing hash, reduced to the number of tables by a multiply-shift.
+     * @param kmer The target kmer
+     * @return uint64_t The bin
+     */
+    static inline uint_fast32_t compute_bin(const kmer_t& kmer)
+    {
+        if (superkmer_size) return superkmer_bin(kmer);
+        return ((unsigned __int128) mix_hash<kmer_t, bin_seed>()(kmer) * table_count) >> 64;
+    }
+
     /**
-     * This method shift updates the reverse complement bin for a kmer
-    */
-    static uint_fast32_t shift_update_rc_bin(uint_fast32_t& rc_bin, uint_fast8_t& left, uint_fast8_t& right);
+     * This method computes the bin of a k-mer from its minimizer, so that consecutive k-mers (a super-k-mer) share their bin.
+     * @param kmer The target kmer
+     * @return uint64_t The bin
+     */
+    static uint_fast32_t superkmer_bin(const kmer_t& kmer);
 
     /**
-    * This function shift updates a bin for an amino kmer
-    */
-    static uint_fast32_t shift_update_amino_bin(uint_fast32_t& bin, kmerAmino_t& kmer, uint_fast8_t& right);
+     * This method reduces the hash of a minimizer to a bin, hashed again because the smallest hashes are not uniform.
+     * @param min The smallest s-mer hash of a k-mer
+     * @return uint64_t The bin
+     */
+    static inline uint_fast32_t minimizer_bin(const uint64_t& min)
+    {
+        return ((unsigned __int128) mix_hash<uint64_t, bin_seed>()(min) * table_count) >> 64;
+    }
 
     /**
-     *  This method computes the bin of a given kmer(slower than shift update)
+     *  This function computes the bin of a given amino kmer from a mixing hash, reduced to the number of tables by a multiply-shift.
      * @param kmer The target kmer
      * @return uint64_t The bin
      */
-     
-    static uint_fast32_t compute_bin(const kmer_t& kmer);
+    static inline uint_fast32_t compute_amino_bin(const kmerAmino_t& kmer)
+    {
+        return ((unsigned __int128) mix_hash<kmerAmino_t, bin_seed>()(kmer) * table_count) >> 64;
+    }
+
+    /**
+     * This function reports the distribution of k-mers over the bins, i.e., the load balance of the tables and their locks.
+     * @param out output stream
+     */
+    static void print_bin_statistics(ostream& out);
+
+    /**
+     * This function prefetches the lock and the tables of a bin, so that a later insertion does not stall on memory.
+     * @param bin The bin to prefetch
+     */
+    static inline void prefetch_bin(const uint_fast32_t& bin)
+    {
+        __builtin_prefetch(&lock[bin], 1);
+        __builtin_prefetch(&kmer_table[bin]);
+        __builtin_prefetch(&singleton_kmer_table[bin]);
+    }
+
+    /**
+     * This function prefetches the lock and the amino tables of a bin, so that a later insertion does not stall on memory.
+     * @param bin The bin to prefetch
+     */
+    static inline void prefetch_amino_bin(const uint_fast32_t& bin)
+    {
+        __builtin_prefetch(&lock[bin], 1);
+        __builtin_prefetch(&kmer_tableAmino[bin]);
+        __builtin_prefetch(&singleton_kmer_tableAmino[bin]);
+    }
+
+    /**
+     * This function prefetches the buckets a k-mer is looked up in, once the tables of its bin have been prefetched.
+     * The bucket position depends on the current size of the tables, so it is read under the shared lock of the bin.
+     * @param bin The bin of the kmer
+     * @param kmer The kmer to be inserted
+     */
+    static inline void prefetch_buckets(const uint_fast32_t& bin, const kmer_t& kmer)
+    {
+        if (sorting) return;    // the tables are not used when counting by sorting
+        lock[bin].lock_shared();
+        kmer_table[bin].prefetch(kmer);
+        singleton_kmer_table[bin].prefetch(kmer);
+        lock[bin].unlock_shared();
+    }
+
+    /**
+     * This function prefetches the buckets an amino k-mer is looked up in, once the tables of its bin have been prefetched.
+     * @param bin The bin of the kmer
+     * @param kmer The kmer to be inserted
+     */
+    static inline void prefetch_amino_buckets(const uint_fast32_t& bin, const kmerAmino_t& kmer)
+    {
+        if (sorting) return;
+        lock[bin].lock_shared();
+        kmer_tableAmino[bin].prefetch(kmer);
+        singleton_kmer_tableAmino[bin].prefetch(kmer);
+        lock[bin].unlock_shared();
+    }
+
+    /**
+    * This function stores a qualified k-mer, i.e., hashes it or appends it to the pair buffer of the thread when counting by sorting.
+    * @param T The thread processing the kmer
+    * @param bin The bin, the kmer is stored in
+    * @param kmer The kmer to store
+    * @param color The color to store
+    */
+    template<bool count_kmers>
+    static inline void store_kmer(const uint64_t& T, uint_fast32_t& bin, const kmer_t& kmer, const uint16_t& color)
+    {
+        if (sorting) {
+            kmer_buffer[T][bin % partition_count].push_back({kmer, color});
+            if (spill_size && ++buffered[8*T] == spill_size) spill_buffer(T);
+        }
+        else hash_kmer<count_kmers>(bin, kmer, color);
+    }
+
+    /**
+    * This function stores a qualified amino k-mer, i.e., hashes it or appends it to the pair buffer of the thread when counting by sorting.
+    * @param T The thread processing the kmer
+    * @param bin The bin, the kmer is stored in
+    * @param kmer The kmer to store
+    * @param color The color to store
+    */
+    template<bool count_kmers>
+    static inline void store_kmer_amino(const uint64_t& T, uint_fast32_t& bin, const kmerAmino_t& kmer, const uint16_t& color)
+    {
+        if (sorting) {
+            kmer_bufferAmino[T][bin % partition_count].push_back({kmer, color});
+            if (spill_size && ++buffered[8*T] == spill_size) spill_buffer(T);
+        }
+        else hash_kmer_amino<count_kmers>(bin, kmer, color);
+    }
+
+    /**
+    * This function hashes a k-mer and stores it in the correstponding hash table.
+    * The corresponding table is chosen by the carry of the encoded k-mer given the number of tables as module.
+    * A k-mer that is already stored only gets its color bit set atomically under the shared lock of its bin,
+    * only insertions and singleton promotions take the bin lock exclusively.
+    * @param bin The bin, the kmer is stored in
+    * @param kmer The kmer to store
+    * @param color The color to store 
+    */
+    template<bool count_kmers>
+    static void hash_kmer(uint_fast32_t& bin, const kmer_t& kmer, const uint16_t& color)
+    {
+        lock[bin].lock_shared();
+        hash_map<kmer_t,kmer_color_t>::iterator entry=kmer_table[bin].find(kmer); 
+        // already in the kmer table? -> add
+        if(entry != kmer_table[bin].end()){
+            bool added;
+            if(set_shared(entry.value(), color, added)){
+                // check if not seen in this genome before, i.e., count a new (unique) kmer
+                if(added && count_kmers){
+                    // count
+                    __atomic_fetch_add(&kmer_counters[color], 1, __ATOMIC_RELAXED);
+                }
+                lock[bin].unlock_shared();
+                return;
+            }
+        }
+        // seen once before in this genome? -> nothing to do
+        else{
+            hash_map<kmer_t,uint16_t>::const_iterator s_entry = singleton_kmer_table[bin].find(kmer);
+            if(s_entry != singleton_kmer_table[bin].end() && s_entry.value() == color){
+                lock[bin].unlock_shared();
+                return;
+            }
+        }
+        lock[bin].unlock_shared();
+
+        lock[bin].lock();
+        insert_kmer<count_kmers>(bin, kmer, color);
+        lock[bin].unlock();
+    }
+
+    /**
+    * This function hashes a run of k-mers of the same bin (e.g. a super-k-mer) under a single acquisition of each lock mode.
+    * @param bin The bin, the kmers are stored in
+    * @param kmers The kmers to store (reordered)
+    * @param n The number of kmers
+    * @param color The color to store
+    */
+    template<bool count_kmers>
+    static void hash_kmers(uint_fast32_t& bin, kmer_t* kmers, uint_fast32_t n, const uint16_t& color)
+    {
+        uint_fast32_t missing = 0;    // the k-mers that need the exclusive lock are moved to the front
+        lock[bin].lock_shared();
+        for (uint_fast32_t i = 0; i < n; ++i) {
+            hash_map<kmer_t,kmer_color_t>::iterator entry=kmer_table[bin].find(kmers[i]);
+            if(entry != kmer_table[bin].end()){
+                bool added;
+                if(set_shared(entry.value(), color, added)){
+                    if(added && count_kmers) __atomic_fetch_add(&kmer_counters[color], 1, __ATOMIC_RELAXED);
+                    continue;
+                }
+            }
+            else{
+                hash_map<kmer_t,uint16_t>::const_iterator s_entry = singleton_kmer_table[bin].find(kmers[i]);
+                if(s_entry != singleton_kmer_table[bin].end() && s_entry.value() == color) continue;
+            }
+            kmers[missing++] = kmers[i];
+        }
+        lock[bin].unlock_shared();
+        if (missing == 0) return;
 
-    /**
-     *  This function computes the bin of a given amino kmer(slower than shift update)
-     * @param kmer The target kmer
-     * @return uint64_t The bin
-     */
-    static uint_fast32_t compute_amino_bin(const kmerAmino_t& kmer);
+        lock[bin].lock();
+        for (uint_fast32_t i = 0; i < missing; ++i) insert_kmer<count_kmers>(bin, kmers[i], color);
+        lock[bin].unlock();
+    }
 
     /**
-    * This function hashes a k-mer and stores it in the correstponding hash table.
-    * The corresponding table is chosen by the carry of the encoded k-mer given the number of tables as module.
+    * This function inserts a k-mer or sets its color, the bin has to be locked exclusively.
     * @param bin The bin, the kmer is stored in
     * @param kmer The kmer to store
-    * @param color The color to store 
+    * @param color The color to store
     */
     template<bool count_kmers>
-    static void hash_kmer(uint_fast32_t& bin, const kmer_t& kmer, const uint16_t& color)
+    static void insert_kmer(uint_fast32_t& bin, const kmer_t& kmer, const uint16_t& color)
     {
-        lock[bin].lock();
-        hash_map<kmer_t,color_t>::iterator entry=kmer_table[bin].find(kmer); 
-        // already in the kmer table?
+        hash_map<kmer_t,kmer_color_t>::iterator entry=kmer_table[bin].find(kmer); 
+        // inserted by another thread in the meantime?
         if(entry != kmer_table[bin].end()){
-            if(count_kmers){
-              // check if not seen in this genome before, i.e., count a new (unique) kmer
-              if(!entry.value().test(color)){
-                // count
-                kmer_counters[color]++;
-              }
+            if(!entry.value().test(color)){
+                entry.value().set(color);
+                if(count_kmers){
+                  // count
+                  __atomic_fetch_add(&kmer_counters[color], 1, __ATOMIC_RELAXED);
+                }
             }
-            // add
-            entry.value().set(color);
         }
         // not yet in the kmer table?
         else{
@@ -483,7 +1079,7 @@ public:
                     singleton_kmer_table[bin].erase(s_entry);
                     if(count_kmers){
                       // count
-                      kmer_counters[color]++;
+                      __atomic_fetch_add(&kmer_counters[color], 1, __ATOMIC_RELAXED);
                     }
                 }
             }
@@ -495,11 +1091,10 @@ public:
                 singleton_counters_locks[color].unlock();
                 if(count_kmers){
                   // count
-                  kmer_counters[color]++;
+                  __atomic_fetch_add(&kmer_counters[color], 1, __ATOMIC_RELAXED);
                 }
             }
         }
-        lock[bin].unlock();
     }
 
 
@@ -507,6 +1102,7 @@ public:
     /**
     * This function hashes an amino k-mer and stores it in the corresponding hash table.
     * The correspontind table is chosen by the carry of the encoded k-mer bitset by the bit-module function.
+    * As for nucleotide k-mers, stored k-mers are updated under the shared lock of their bin.
     * @param bin The bin, the kmer is stored in
     * @param kmer The kmer to store
     * @param color The color to store
@@ -514,22 +1110,35 @@ public:
     template<bool count_kmers>
     static void hash_kmer_amino(uint_fast32_t& bin, const kmerAmino_t& kmer, const uint16_t& color)
     {
-        lock[bin].lock();
-        hash_map<kmerAmino_t,color_t>::iterator entry=kmer_tableAmino[bin].find(kmer); 
+        lock[bin].lock_shared();
+        hash_map<kmerAmino_t,kmer_color_t>::iterator entry=kmer_tableAmino[bin].find(kmer); 
         // already in the kmer table? -> add
-        if(entry != kmer_tableAmino[bin].end()){
+        bool added;
+        if(entry != kmer_tableAmino[bin].end() && set_shared(entry.value(), color, added)){
             // check if not seen in this genome before, i.e., count a new (unique) kmer
+            if(added){
+                // count
+                __atomic_fetch_add(&kmer_counters[color], 1, __ATOMIC_RELAXED);
+            }
+            lock[bin].unlock_shared();
+            return;
+        }
+        lock[bin].unlock_shared();
+
+        lock[bin].lock();
+        entry=kmer_tableAmino[bin].find(kmer); 
+        // inserted by another thread in the meantime?
+        if(entry != kmer_tableAmino[bin].end()){
             if(!entry.value().test(color)){
-                // add
                 entry.value().set(color);
                 // count
-                kmer_counters[color]++;
+                __atomic_fetch_add(&kmer_counters[color], 1, __ATOMIC_RELAXED);
             }
         }
         // not yet in the kmer table?
         else{
             // count
-            kmer_counters[color]++;
+            __atomic_fetch_add(&kmer_counters[color], 1, __ATOMIC_RELAXED);
             hash_map<kmerAmino_t,uint16_t>::iterator s_entry = singleton_kmer_tableAmino[bin].find(kmer);
             //seen once before? -> add to kmer table / remove from singleton table
             if(s_entry != singleton_kmer_tableAmino[bin].end()){
@@ -585,17 +1194,17 @@ public:
 
 
     /**
-     * This function removes the kmer entry from the hash map
+     * This function removes the kmer entry from the hash map (no-op once the tables are frozen)
      */
     static void remove_kmer(const kmer_t& kmer, bool reversed);
 
     /**
-     * This function removes the amino kmer entry from the corresponding hash table
+     * This function removes the amino kmer entry from the corresponding hash table (no-op once the tables are frozen)
      */
     static void remove_kmer_amino(const kmerAmino_t& kmer);
 
 	/**
-	* This function extracts k-mers from a sequence and adds them to the black list.
+	* This function extracts k-mers from a sequence and adds them to the black list, several threads can call it at once.
 	*/
 	static void fill_blacklist(string& str, bool& reverse);
 	
@@ -603,12 +1212,281 @@ public:
 	* This function tells how many k-mers are in the black list.
 	*/
 	static uint64_t size_blacklist();
+
+	/**
+	 * This function writes the blacklist into an index file that later runs memory-map instead of reading the k-mers again.
+	 */
+	static bool save_blacklist(const string& path, bool& reverse);
+
+	/**
+	 * This function tells if a file is a blacklist index rather than a sequence file.
+	 */
+	static bool is_blacklist_index(const string& path);
+
+	/**
+	 * This function memory-maps a blacklist index, shared read-only across concurrent runs.
+	 */
+	static bool load_blacklist(const string& path, bool& reverse);
 	
 	/**
 	 * This function activates using the blacklist while inserting kmers.
 	 */
 	static void activate_blacklist();
-	
+
+	/**
+	 * This function activates counting k-mers by sorting instead of hashing, it has to be called after init.
+	 *
+	 * @param thread_count the number of threads used for processing
+	 */
+	static void activate_sorting(uint64_t& thread_count);
+
+	/**
+	 * This function limits the memory used for counting k-mers by sorting: it activates sorting and spills the buffered pairs
+	 * into on-disk partitions, which are reduced by sort_kmers as far as they fit the limit. It has to be called after init.
+	 *
+	 * @param thread_count the number of threads used for processing
+	 * @param max_memory the number of bytes available for the buffers of all threads and for reducing the partitions
+	 * @param directory the directory to create the partition files in
+	 * @param input_size the (estimated) number of pairs of all input files, an upper bound
+	 * @return false if the partition directory could not be created
+	 */
+	static bool activate_external(uint64_t& thread_count, uint64_t max_memory, string directory, uint64_t input_size);
+
+	/**
+	 * This function moves the coverage check into the reduction of the sorted pairs, it has to be called after activating sorting.
+	 * Every occurrence is buffered (or spilled), a genome is added to the color set of a k-mer once it occurs at least q times
+	 * across all files of the genome. No per-thread quality tables are used, so the memory stays bounded with activate_external.
+	 */
+	static void activate_sort_counting();
+
+	/**
+	 * This function activates forwarding each k-mer only once per input file to the tables, it has to be called after init.
+	 * Repeated occurrences are then filtered by a per-thread map (together with the coverage threshold), not by the shared tables.
+	 *
+	 * @param thread_count the number of threads used for processing
+	 */
+	static void activate_dedup(uint64_t& thread_count);
+
+	/**
+	 * This function sets the coverage thresholds, it is called by init and may be called again before any k-mer is added.
+	 *
+	 * @param q_table coverage threshold per genome (empty if all are the same)
+	 * @param quality global q or maximum among all q values
+	 * @param thread_count the number of threads used for processing
+	 */
+	static void set_quality(vector<int>& q_table, int& quality, uint64_t& thread_count);
+
+	/**
+	 * This function counts the occurrences of the sampled k-mers of a sequence for the abundance spectrum of a genome.
+	 * A k-mer is sampled by its hash, so all of its occurrences are counted (saturating at 255).
+	 *
+	 * @param str dna sequence
+	 * @param counts the occurrences of the sampled k-mers of the genome
+	 * @param reverse merge complements
+	 */
+	static void sample_kmers(string& str, hash_map<kmer_t, uint8_t>& counts, bool& reverse);
+
+	/**
+	 * This function counts the occurrences of the sampled amino k-mers of a sequence for the abundance spectrum of a genome.
+	 *
+	 * @param str amino acid sequence
+	 * @param counts the occurrences of the sampled k-mers of the genome
+	 */
+	static void sample_kmers(string& str, hash_map<kmerAmino_t, uint8_t>& counts);
+
+	/**
+	 * This function computes the abundance spectrum from the occurrences of the sampled k-mers.
+	 *
+	 * @param counts the occurrences of the sampled k-mers of a genome
+	 * @return the number of sampled k-mers per occurrence count (index 0 is unused, the last entry is non-zero)
+	 */
+	template <typename K>
+	static vector<uint64_t> spectrum(const hash_map<K, uint8_t>& counts) {
+		vector<uint64_t> histogram(256, 0);
+		for (auto& it : counts) histogram[it.second]++;
+		while (histogram.size() > 1 && histogram.back() == 0) histogram.pop_back();
+		return histogram;
+	}
+
+	/**
+	 * This function chooses a coverage threshold from an abundance spectrum: the valley after the peak of erroneous k-mers.
+	 * Without a distinct coverage peak after the valley (e.g. for assemblies), the threshold is 1.
+	 *
+	 * @param histogram the abundance spectrum of a genome
+	 * @return the coverage threshold
+	 */
+	static int spectrum_threshold(const vector<uint64_t>& histogram);
+
+	/**
+	 * This is the sampling rate of the abundance spectrum: one in so many k-mers is counted.
+	 * The shape of the spectrum is kept, while the counters of a read set shrink by this factor.
+	 */
+	static constexpr uint64_t spectrum_sampling = 64;
+
+	/**
+	 * These decide if there is a coverage peak after the valley of the spectrum: the peak has to reach at least
+	 * spectrum_peak_factor times the sampled k-mers at the valley plus spectrum_peak_margin. The margin keeps
+	 * the few repeated k-mers of an assembly (about 16 * 64 k-mers in total before sampling) from being taken for coverage.
+	 */
+	static constexpr uint64_t spectrum_peak_factor = 2;
+	static constexpr uint64_t spectrum_peak_margin = 16;
+
+	/**
+	 * This is the scaling factor of the FracMinHash sample: only k-mers with a hash of at most max/scaled are kept (1: all).
+	 */
+	static uint64_t scaled;
+
+	/**
+	 * This is the largest hash of a k-mer in the FracMinHash sample.
+	 */
+	static uint64_t scaled_max;
+
+	/**
+	 * This is the seed of the hash function selecting the k-mers of the FracMinHash sample (the same in every run).
+	 */
+	static constexpr uint64_t scaled_seed = 0x510e527fade682d1u;
+
+	/**
+	 * This function activates keeping only a FracMinHash sample of about one in s k-mers, the split weights are scaled back up by s.
+	 *
+	 * @param s the scaling factor
+	 */
+	static void activate_scaled(const uint64_t& s);
+
+	/**
+	 * This function checks if a (canonical) k-mer belongs to the FracMinHash sample.
+	 *
+	 * @param kmer the k-mer
+	 * @return true if the k-mer is kept
+	 */
+	template <typename K>
+	static inline bool in_sample(const K& kmer) {
+		return mix_hash<K, scaled_seed>()(kmer) <= scaled_max;
+	}
+
+	/**
+	 * This is the length of the s-mers deciding the syncmers (0: all k-mers are kept).
+	 */
+	static uint64_t syncmer_size;
+
+	/**
+	 * This indicates closed instead of open syncmers.
+	 */
+	static bool syncmer_closed;
+
+	/**
+	 * These are the per-thread rolling s-mer minima deciding the syncmers.
+	 */
+	static vector<smer_window> syncmer_state;
+
+	/**
+	 * This function activates keeping only the syncmers among the (nucleotide) k-mers.
+	 * The expected density is 2/(k-s+1) for closed and 1/(k-s+1) for open syncmers, independent of the neighbouring sequence.
+	 *
+	 * @param s the s-mer length (less than k, at most 32)
+	 * @param closed closed (smallest s-mer at the start or end) instead of open (smallest s-mer in the middle) syncmers
+	 * @param reverse merge complements
+	 * @param thread_count the number of threads used for processing
+	 */
+	static void activate_syncmers(const uint64_t& s, const bool& closed, const bool& reverse, uint64_t& thread_count);
+
+	/**
+	 * This is the length of the minimizers selecting the bins of the k-mers (0: bins by the hash of the k-mer).
+	 */
+	static uint64_t superkmer_size;
+
+	/**
+	 * These are the per-thread rolling minimizers of the super-k-mers.
+	 */
+	static vector<smer_window> superkmer_state;
+
+	/**
+	 * This is the maximal number of consecutive k-mers of the same bin inserted together.
+	 */
+	static constexpr uint_fast32_t run_capacity = 64;
+
+	/**
+	 * This function activates selecting the bin of a (nucleotide) k-mer by its minimizer instead of its hash.
+	 * Consecutive k-mers mostly share their minimizer, so runs of them are inserted with a single lock acquisition.
+	 *
+	 * @param m the minimizer length (less than k, at most 32)
+	 * @param thread_count the number of threads used for processing
+	 */
+	static void activate_superkmers(const uint64_t& m, uint64_t& thread_count);
+
+	/**
+	 * These are the per-thread resolutions of ambiguous (IUPAC) words.
+	 */
+	static vector<iupac_window<false>> iupac_state;
+	static vector<iupac_window<true>> iupac_stateAmino;
+
+	/**
+	 * This function activates resolving the ambiguous (IUPAC) characters of the sequences.
+	 *
+	 * @param thread_count the number of threads used for processing
+	 */
+	static void activate_iupac(uint64_t& thread_count);
+
+	/**
+	 * This is the seed of the hash function ordering the k-mers of a minimizer window.
+	 */
+	static constexpr uint64_t minimizer_seed = 0xa54ff53a5f1d36f1u;
+
+	/**
+	 * This is the seed of the hash function sampling the k-mers of the abundance spectrum.
+	 */
+	static constexpr uint64_t spectrum_seed = 0x3c6ef372fe94f82bu;
+
+	/**
+	 * This function activates the count-min sketch prefilter for the coverage threshold, it has to be called after init.
+	 * A k-mer is only kept (once per input file) when its estimated number of occurrences reaches the threshold,
+	 * so erroneous k-mers are never stored. Collisions may let a k-mer pass with fewer occurrences.
+	 *
+	 * @param thread_count the number of threads used for processing
+	 * @param budget the total memory of the sketches of all threads in bytes
+	 */
+	static void activate_sketch(uint64_t& thread_count, const uint64_t& budget);
+
+	/**
+	 * This function activates counting the occurrences for the coverage threshold per genome instead of per file, it has to be called after init.
+	 * All threads reading files of the same genome update its shared counters, each k-mer is forwarded once per genome.
+	 *
+	 * @param file_counts the number of input files per genome
+	 */
+	static void activate_genome_counting(const vector<uint32_t>& file_counts);
+
+	/**
+	 * This function prepares the shared counters of a genome before one of its files is read.
+	 *
+	 * @param color the genome
+	 */
+	static void begin_genome_file(const uint16_t& color);
+
+	/**
+	 * This function releases the shared counters of a genome once its last file has been read.
+	 *
+	 * @param color the genome
+	 */
+	static void end_genome_file(const uint16_t& color);
+
+	/**
+	 * This function resets the sketch of a thread for the next input file.
+	 *
+	 * @param T the thread
+	 * @param bytes the (estimated) size of the input file, each row of the sketch has about one counter per base up to the budget
+	 */
+	static void reset_sketch(const uint64_t& T, const uint64_t& bytes);
+
+	/**
+	 * This function sorts the buffered (k-mer, color) pairs and reduces them into the color table and the k-mer counters.
+	 * It replaces add_weights for the k-mers read while sorting is active.
+	 *
+	 * @param thread_count the number of threads used for processing
+	 * @param keep_core collect the core k-mers for output_core
+	 * @param verbose print progress
+	 */
+	static void sort_kmers(uint64_t& thread_count, bool keep_core, bool& verbose);
+
     /**
      * This function extracts k-mers from a sequence and adds them to the hash table.
      *
@@ -649,12 +1527,43 @@ public:
      */
     static void add_minimizers(uint64_t& T, string& str, uint16_t& color, bool& reverse, uint64_t& m, uint64_t& max_iupac);
 
+    /**
+     * This function translates a coding sequence and adds its amino acid k-mers to the hash table.
+     * Each codon is looked up by the masks of its bases and shifted into the k-mer as it is read, untranslated codons start a new k-mer.
+     *
+     * @param str dna sequence (in frame)
+     * @param color color flag
+     */
+    static void add_codons(uint64_t& T, string& str, uint16_t& color);
+
+    /**
+     * This function translates a sequence in all six reading frames and adds their amino acid k-mers to the hash table.
+     * A single pass keeps the rolling codon of both strands, the reverse frames are built from right to left.
+     *
+     * @param str dna sequence
+     * @param color color flag
+     * @param stops break the k-mers at stop codons
+     */
+    static void add_frames(uint64_t& T, string& str, uint16_t& color, bool& stops);
+
 	/**
 	* This function calculates the weight for all splits and puts them into the split_ölist
 	* @param mean weight function
 	* @param min_value the minimal weight represented in the top list
+	* @param thread_count the number of threads used for computing and selecting the weights
+	*/
+	static void compile_split_list(double mean(uint64_t&, uint64_t&), double min_value, uint64_t& thread_count);
+
+	/**
+	* This function freezes the k-mer tables after reading: each bin is moved into sorted arrays of k-mers
+	* and color class ids, and released. The tables must not be modified afterwards.
+	* Without keeping the k-mers (no core k-mers or lookups needed), each bin is consumed into the color table
+	* right away instead, i.e., add_weights is done bin by bin while the memory of the tables is released.
+	* @param keep_kmers keep the k-mers in the frozen arrays
+	* @param thread_count the number of threads used for consuming the bins
+	* @param verbose print progess
 	*/
-	static void compile_split_list(double mean(uint32_t&, uint32_t&), double min_value);
+	static void freeze_tables(bool keep_kmers, uint64_t& thread_count, bool& verbose);
 
 	/**
 	* This function determines the core k-mers, i.e., all k-mers present in all genomes.
@@ -711,10 +1620,11 @@ public:
      * This function iterates over the hash table and calculates the split weights.
      *
      * @param mean weight function
-     * @param verbose print progress
      * @param min_value the minimal weight currently represented in the top list
+     * @param thread_count the number of threads used for processing
+     * @param verbose print progress
      */
-    static void add_weights(double mean(uint32_t&, uint32_t&), double min_value, bool& verbose);
+    static void add_weights(double mean(uint64_t&, uint64_t&), double min_value, uint64_t& thread_count, bool& verbose);
 	
 	
 	/**
@@ -724,7 +1634,7 @@ public:
 	* @param min_value the minimal weight represented in the top list
 	* @param verbose print progess
 	*/
-	static void add_singleton_weights(double mean(uint32_t&, uint32_t&), double min_value, bool& verbose);
+	static void add_singleton_weights(double mean(uint64_t&, uint64_t&), double min_value, bool& verbose);
 
 
     /**
@@ -817,6 +1727,28 @@ public:
 
 protected:
 
+    /**
+     * These are the sequence processing functions instantiated for the emplace policy of the current run.
+     */
+    static void (*add_kmers_selected)(uint64_t&, string&, uint16_t&, bool&);
+    static void (*add_minimizers_selected)(uint64_t&, string&, uint16_t&, bool&, uint64_t&);
+    static void (*add_iupac_kmers_selected)(uint64_t&, string&, uint16_t&, bool&, uint64_t&);
+    static void (*add_iupac_minimizers_selected)(uint64_t&, string&, uint16_t&, bool&, uint64_t&, uint64_t&);
+    static void (*add_codons_selected)(uint64_t&, string&, uint16_t&);
+    static void (*add_frames_selected)(uint64_t&, string&, uint16_t&, bool&);
+
+    /**
+     * This function selects the emplace policy matching the current settings, i.e., amino processing,
+     * blacklist, coverage threshold, and counting, once before the sequences are processed.
+     */
+    static void select_pipeline();
+
+    /**
+     * This function installs the sequence processing functions of the given emplace policy.
+     */
+    template <typename policy>
+    static void select_pipeline();
+
     /**
      * This function qualifies a k-mer and places it into the hash table.
      *
@@ -825,64 +1757,210 @@ protected:
      * @param kmer bit sequence
      * @param color color flag
      */
-    static function<void(const uint64_t& T, uint_fast32_t& bin, const kmer_t&, const uint16_t&)> emplace_kmer;
-    static function<void(const uint64_t& T, uint_fast32_t& bin, const kmer_t&, const uint16_t&)> emplace_kmer_tmp;
+    template <typename policy>
+    static inline void emplace_kmer(const uint64_t& T, uint_fast32_t& bin, const kmer_t& kmer, const uint16_t& color)
+    {
+        if (qualify_kmer<policy>(T, kmer, color)) store_kmer<policy::count_kmers>(T, bin, kmer, color);
+    }
+
+    /**
+     * This function qualifies a run of k-mers of the same bin (e.g. a super-k-mer) and places the qualified ones into the hash table together.
+     *
+     * @param T number of thread processing the kmers
+     * @param bin The bin, the kmers are stored in
+     * @param kmers bit sequences (overwritten)
+     * @param n number of kmers
+     * @param color color flag
+     */
+    template <typename policy>
+    static inline void emplace_run(const uint64_t& T, uint_fast32_t& bin, kmer_t* kmers, uint_fast32_t n, const uint16_t& color)
+    {
+        uint_fast32_t kept = 0;
+        for (uint_fast32_t i = 0; i < n; ++i) if (qualify_kmer<policy>(T, kmers[i], color)) kmers[kept++] = kmers[i];
+        if (kept == 0) return;
+        if (sorting) for (uint_fast32_t i = 0; i < kept; ++i) store_kmer<policy::count_kmers>(T, bin, kmers[i], color);
+        else hash_kmers<policy::count_kmers>(bin, kmers, kept, color);
+    }
 
     /**
-     * This function qualifies a k-mer and places it into the hash table.
+     * This function decides if a k-mer is placed into the hash table: it is not blacklisted and passes the coverage check.
+     * The nucleotide and amino k-mers share this gating, they only differ in the per-thread tables.
+     *
+     * @param T number of thread processing the kmer
+     * @param kmer bit sequence
+     * @param color color flag
+     * @return true if the k-mer is to be stored
+     */
+    template <typename policy, bool amino = false, typename K>
+    static inline bool qualify_kmer(const uint64_t& T, const K& kmer, const uint16_t& color)
+    {
+        auto& q_map = pick<amino>(quality_map, quality_mapAmino);
+        auto& q_set = pick<amino>(quality_set, quality_setAmino);
+
+        // only add if kmer not in blacklist
+        if constexpr (policy::blacklisted) {
+            if constexpr (amino) { if (in_blacklist_amino(kmer)) return false; }
+            else if (in_blacklist(kmer)) return false;
+        }
+
+        if (policy::q_mode == 0) {
+            // forward the k-mer once it reaches the threshold, and never again for this file
+            uint16_t& count = q_map[T][kmer];
+            if (count == forwarded || ++count < (policy::q_per_genome ? q_table[color] : quality)) return false;
+            count = forwarded;
+        } else if (policy::q_mode == 4) {
+            // forward the k-mer once its estimate reaches the threshold, and never again for this file
+            if (q_map[T].contains(kmer)) return false;
+            int threshold = policy::q_per_genome ? q_table[color] : quality;
+            if (pick<amino>(quality_sketch, quality_sketchAmino)[T].add(kmer) < std::min(threshold, 255)) return false;
+            q_map[T].emplace(kmer, forwarded);
+        } else if (policy::q_mode == 5) {
+            // forward the k-mer once its count for the genome reaches the threshold, and never again for this genome
+            int threshold = policy::q_per_genome ? q_table[color] : quality;
+            if (!pick<amino>(genome_counts, genome_countsAmino)[color]->add(kmer, std::min(threshold, 255))) return false;
+        } else if (policy::q_mode == 2 && !(policy::q_per_genome && q_table[color] == 1)) {
+            if (q_set[T].find(kmer) == q_set[T].end()) {
+                q_set[T].emplace(kmer);
+                return false;
+            }
+            q_set[T].erase(kmer);
+        } else if (policy::q_mode == 3) {
+            uint16_t& count = q_map[T][kmer];
+            if (count < (policy::q_per_genome ? q_table[color] : quality)-1) {
+                count++;
+                return false;
+            }
+            q_map[T].erase(kmer);
+        }
+        return true;
+    }
+
+    /**
+     * This function selects the nucleotide or the amino variant of a per-thread table.
+     */
+    template <bool amino, typename A, typename B>
+    static inline auto& pick(A& nucleotide, B& amino_acid)
+    {
+        if constexpr (amino) return amino_acid;
+        else return nucleotide;
+    }
+
+    /**
+     * This function qualifies an amino k-mer and places it into the hash table.
      *
      * @param T number of thread processing the kmer
      * @param bin The bin, the kmer is stored in
      * @param kmer bit sequence
      * @param color color flag
      */
-    static function<void(const uint64_t& T, uint_fast32_t& bin, const kmerAmino_t&, const uint16_t&)> emplace_kmer_amino;
-    static function<void(const uint64_t& T, uint_fast32_t& bin, const kmerAmino_t&, const uint16_t&)> emplace_kmer_amino_tmp;
+    template <typename policy>
+    static inline void emplace_kmer_amino(const uint64_t& T, uint_fast32_t& bin, const kmerAmino_t& kmer, const uint16_t& color)
+    {
+        if (qualify_kmer<policy, true>(T, kmer, color)) store_kmer_amino<policy::count_kmers>(T, bin, kmer, color);
+    }
 
     /**
-     * This function tests if a split is compatible with an existing set of splits.
+     * These are the sequence processing functions for a given emplace policy, see the public counterparts.
+     */
+    template <typename policy>
+    static void add_kmers(uint64_t& T, string& str, uint16_t& color, bool& reverse);
+    template <typename policy>
+    static void add_minimizers(uint64_t& T, string& str, uint16_t& color, bool& reverse, uint64_t& m);
+    template <typename policy>
+    static void add_kmers(uint64_t& T, string& str, uint16_t& color, bool& reverse, uint64_t& max_iupac);
+    template <typename policy>
+    static void add_minimizers(uint64_t& T, string& str, uint16_t& color, bool& reverse, uint64_t& m, uint64_t& max_iupac);
+    template <typename policy>
+    static void add_codons(uint64_t& T, string& str, uint16_t& color);
+    template <typename policy>
+    static void add_frames(uint64_t& T, string& str, uint16_t& color, bool& stops);
+
+    /**
+     * This function moves the bins of a k-mer table into the frozen arrays.
      *
-     * @param color new split
-     * @param color_set set of splits
-     * @return true, if compatible
+     * @param table the k-mer table (released)
+     * @param kmers the frozen k-mers
+     * @param keep_kmers keep the k-mers, else their colors are added to the color table
+     * @param thread_count the number of threads used for consuming the bins
+     * @param verbose print progess
      */
-    static bool test_strict(color_t& color, vector<color_t>& color_set);
+    template <typename K>
+    static void freeze(vector<hash_map<K, kmer_color_t>>& table, vector<K>& kmers, bool keep_kmers, uint64_t& thread_count, bool& verbose);
 
     /**
-     * This function tests if a split is weakly compatible with an existing set of splits.
+     * This function adds the colors of a range of items (e.g. bins) to the color table in parallel.
+     * Each thread adds into its own color tables, one per shard of the colors, then the shards are merged in parallel
+     * and inserted into the color table.
      *
-     * @param color new split
-     * @param color_set set of splits
-     * @return true, if weakly compatible
+     * @param count the number of items
+     * @param colors_of called as colors_of(i, add) for each item i, calls add(color, n) to add n k-mers of a color
+     * @param thread_count the number of threads used for processing
+     * @param step progress message
+     * @param verbose print progress
      */
-    static bool test_weakly(color_t& color, vector<color_t>& color_set);
+    template <typename F>
+    static void accumulate_colors(const uint64_t& count, F colors_of, uint64_t& thread_count, const string& step, bool& verbose);
 
     /**
-     * This function calculates the multiplicity of iupac k-mers.
+     * This function searches a frozen k-mer in its bin.
      *
-     * @param product overall multiplicity
-     * @param factors per base multiplicity
-     * @param input iupac character
+     * @param kmers the frozen k-mers
+     * @param bin the bin of the k-mer
+     * @param kmer the k-mer to search
+     * @return the index of the k-mer or the size of the frozen arrays if not found
      */
-    static void iupac_calc(long double& product, vector<uint8_t>& factors, char& input);
+    template <typename K>
+    static uint64_t find_frozen(const vector<K>& kmers, const uint_fast32_t& bin, const K& kmer);
 
     /**
-     * This function shifts a base into a set of ambiguous iupac k-mers.
+     * This function appends the buffered pairs of a thread to the spilled partitions and empties its buffers.
      *
-     * @param prev set of k-mers
-     * @param next set of k-mers
-     * @param input iupac character
+     * @param T the thread whose buffers are spilled
      */
-    static void iupac_shift(hash_set<kmer_t>& prev, hash_set<kmer_t>& next, char& input);
+    static void spill_buffer(const uint64_t& T);
 
     /**
-   * This function shifts a base into a set of ambiguous iupac k-mers.
-   *
-   * @param prev set of k-mers
-   * @param next set of k-mers
-   * @param input iupac character
-   */
-    static void iupac_shift_amino(hash_set<kmerAmino_t>& prev, hash_set<kmerAmino_t>& next, char& input);
+     * This function returns the file a partition is spilled to.
+     *
+     * @param p the partition
+     */
+    static string bucket_path(const uint_fast32_t& p);
+
+    /**
+     * This function removes the spilled partitions and their directory, it is registered at exit by activate_external.
+     */
+    static void remove_buckets();
+
+    /**
+     * This function sorts the partitions of a pair buffer in parallel and reduces each run of equal k-mers to its color set.
+     *
+     * @param buffer per-thread pair buffers, one for each partition (released during processing)
+     * @param core collects the core k-mers
+     * @param bits the number of bits used by a k-mer
+     * @param thread_count the number of threads used for processing
+     * @param keep_core collect the core k-mers
+     * @param verbose print progress
+     */
+    template <typename K>
+    static void reduce_partitions(vector<vector<vector<colored_kmer<K>>>>& buffer, vector<K>& core, const uint_fast32_t& bits, uint64_t& thread_count, bool keep_core, bool& verbose);
+
+    /**
+     * This function tests if a split is compatible with an existing set of splits.
+     *
+     * @param color new split
+     * @param color_set set of splits
+     * @return true, if compatible
+     */
+    static bool test_strict(color_t& color, vector<color_t>& color_set);
+
+    /**
+     * This function tests if a split is weakly compatible with an existing set of splits.
+     *
+     * @param color new split
+     * @param color_set set of splits
+     * @return true, if weakly compatible
+     */
+    static bool test_weakly(color_t& color, vector<color_t>& color_set);
 
     /**
      * This function returns a tree structure (struct node) generated from the given list of color sets.
@@ -41,6 +41,21 @@ void kmer::shift(kmer_t& kmer, char& c_right) {
     kmer &= mask;    // set all bits to zero that exceed the k-mer length
 }
 
+/**
+ * This function shifts a reverse complement k-mer, prepending the complement of a new character to the left.
+ *
+ * @param rcmer bit sequence of the reverse complement
+ * @param right right character of the forward k-mer in binary-code
+ */
+void kmer::shift_reverse(kmer_t& rcmer, uint_fast8_t& right) {
+    rcmer >>= 02u;    // shift all current bits to the right by two positions
+    #if maxK <= 32
+        rcmer |= (kmer_t) (0b11u ^ right) << (2*k-2);    // encode the complement as the new leftmost character
+    #else
+        if (!(right & 0b10u)) rcmer.set(2*k-1);    // encode the complement as the new leftmost character
+        if (!(right & 0b01u)) rcmer.set(2*k-2);
+    #endif
+}
 
 
 /**
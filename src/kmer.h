@@ -58,6 +58,15 @@ class kmer {
     */
     static void shift(kmer_t& kmer, char& c_right);
 
+    /**
+     * This function shifts a reverse complement k-mer, prepending the complement of a new character to the left.
+     * Together with shift, this maintains both orientations of a rolling k-mer in constant time.
+     *
+     * @param rcmer bit sequence of the reverse complement
+     * @param right right character of the forward k-mer in binary-code
+     */
+    static void shift_reverse(kmer_t& rcmer, uint_fast8_t& right);
+
     /**
      * This function unshifts a k-mer returning the character on the right.
      *
@@ -34,6 +34,19 @@ void kmerAmino::shift_left(kmerAmino_t& kmer, char& chr) {
     kmer &= mask;    // set all bits to zero that exceed the k-mer length
 }
 
+/**
+ * This function shifts a k-mer adding a new character to the left.
+ *
+ * @param kmer bit sequence
+ * @param chr left character in binary-code
+ */
+void kmerAmino::shift_left(kmerAmino_t& kmer, uint8_t& chr) {
+    uint64_t left = chr;    // new leftmost character
+    kmer >>= 05u;    // shift all current bits to the right by five positions
+    kmer |= left << (5*k-05u);    // encode the new character within the leftmost five bits
+    kmer &= mask;    // set all bits to zero that exceed the k-mer length
+}
+
 /**
  * This function shifts a k-mer adding a new character to the right.
  *
@@ -48,6 +61,18 @@ void kmerAmino::shift_right(kmerAmino_t& kmer, char& chr) {
     kmer &= mask;    // set all bits to zero that exceed the k-mer length
 }
 
+/**
+ * This function shifts a k-mer adding a new character to the right.
+ *
+ * @param kmer bit sequence
+ * @param right right character in binary-code
+ */
+void kmerAmino::shift_right(kmerAmino_t& kmer, uint8_t& right) {
+    kmer <<= 05u;    // shift all current bits to the left by five positions
+    kmer |= right;    // encode the new character within the rightmost five bits
+    kmer &= mask;    // set all bits to zero that exceed the k-mer length
+}
+
 /**
  * This function unshifts a k-mer returning the character on the right.
  *
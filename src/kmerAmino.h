@@ -49,6 +49,14 @@ class kmerAmino {
      */
     static void shift_left(kmerAmino_t& kmer, char& chr);
 
+    /**
+     * This function shifts a k-mer appending a new character to the left.
+     *
+     * @param kmer bit sequence
+     * @param chr left character in binary-code
+     */
+    static void shift_left(kmerAmino_t& kmer, uint8_t& chr);
+
     /**
      * This function shifts a k-mer adding a new character to the right.
      *
@@ -56,6 +64,14 @@ class kmerAmino {
      * @param c right character
      */
     static void shift_right(kmerAmino_t& kmer, char& c);
+
+    /**
+     * This function shifts a k-mer adding a new character to the right.
+     *
+     * @param kmer bit sequence
+     * @param right right character in binary-code
+     */
+    static void shift_right(kmerAmino_t& kmer, uint8_t& right);
 	
 	/**
 	* This function unshifts a k-mer returning the character on the right.
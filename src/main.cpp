@@ -40,7 +40,11 @@ int main(int argc, char* argv[]) {
         cout << "    -s, --splits  \t Splits file: load an existing list of splits file" << endl;
         cout << "                  \t (allows to filter -t/-f, other arguments are ignored)" << endl;
         cout << endl;
-        cout << "    -B, --blacklist\t File (Fasta, Fastq) of k-mers to be ignored" << endl;
+        cout << "    -B, --blacklist\t File (Fasta, Fastq) of k-mers to be ignored, or a blacklist index (see -J)" << endl;
+        cout << endl;
+        cout << "    -J, --blacklist-index\t Index file: write the k-mers of --blacklist into a file that later runs" << endl;
+        cout << "                  \t memory-map as --blacklist (needs the same -k, -a/-c/-6, and -n as these runs)" << endl;
+        cout << "                  \t (--input and output arguments are optional)" << endl;
         cout << endl;
         cout << "    (either --input and/or --graph, or --splits must be provided)" << endl;
         cout << endl;
@@ -69,6 +73,7 @@ int main(int argc, char* argv[]) {
         cout << "    -R, --raw  \t\t Output both counts per split in TSV file" << endl;
         cout << endl;
         cout << "    -A, --stats  \t Output k-mer counts per genome in TSV file: genome, (different) k-mers, singleton k-mers, std devs from mean" << endl;
+        cout << "                 \t With --qualify auto: threshold and sampled k-mer spectrum (k-mers seen 1, 2, ... times)" << endl;
         cout << endl;
         cout << "    (at least --output, --newick, --nexus, --pdf, --svg, --core, --raw, or --stats must be provided)" << endl;
         cout << endl;
@@ -76,8 +81,15 @@ int main(int argc, char* argv[]) {
         cout << endl;
         cout << "    -k, --kmer    \t Length of k-mers (default: 31, or 10 for --amino and --code)" << endl;
         cout << endl;
-        // cout << "    -w, --window  \t Number of k-mers per minimizer window (default: 1)" << endl;
-        // cout << endl;
+        cout << "    -w, --window  \t Number of k-mers per minimizer window (default: 1)" << endl;
+        cout << endl;
+        cout << "    -y, --syncmer \t Keep only the syncmers of the k-mers, by the position of their smallest s-mer" << endl;
+        cout << "                  \t Specify s, optional: closed (at start or end, default) or open (in the middle)" << endl;
+        cout << "                  \t (expected density 2/(k-s+1) respectively 1/(k-s+1), only for nucleotides)" << endl;
+        cout << endl;
+        cout << "    -F, --scaled  \t Keep only a FracMinHash sample of about one in s k-mers (default: 1)" << endl;
+        cout << "                  \t Split weights are scaled by s, the sample is the same in every run" << endl;
+        cout << endl;
         cout << "    -t, --top     \t Number of splits in the output list (default: all)." << endl;
         cout << "                  \t Use -t <integer>n to limit relative to number of input files, or" << endl;
         cout << "                  \t use -t <integer> to limit by absolute value." << endl;
@@ -103,6 +115,10 @@ int main(int argc, char* argv[]) {
         cout << "                  \t Without --iupac respective k-mers are ignored" << endl;
         cout << endl;
         cout << "    -q, --qualify \t Discard k-mers with lower coverage than a threshold" << endl;
+        cout << "                  \t auto: choose the threshold per genome from its sampled k-mer spectrum" << endl;
+        cout << "                  \t (the valley after the error peak, 1 if there is none)" << endl;
+        cout << "                  \t this reads all input files once more before counting" << endl;
+        cout << "                  \t with --sketch, the coverage is estimated within a fixed memory budget" << endl;
         cout << endl;
         cout << "    -n, --norev   \t Do not consider reverse complement k-mers" << endl;
         cout << endl;
@@ -116,6 +132,10 @@ int main(int argc, char* argv[]) {
         cout << "                  \t Use 11 for Bacterial, Archaeal, and Plant Plastid Code" << endl;
         cout << "                  \t (See https://www.ncbi.nlm.nih.gov/Taxonomy/Utils/wprintgc.cgi for details.)" << endl;
         cout << endl;
+        cout << "    -6, --six-frame\t Translate DNA in all six reading frames: --input provides unannotated genomes" << endl;
+        cout << "                  \t Implies --norev and a default k of 10, the genetic code is chosen by --code" << endl;
+        cout << "                  \t optional: stop, break the amino acid k-mers at stop codons" << endl;
+        cout << endl;
         cout << "    -M, --maxN    \t Compare number of input genomes to compile paramter DmaxN" << endl;
         cout << "                  \t Add path/to/makefile (default is makefile in current working directory)." << endl;
         cout << endl;
@@ -137,6 +157,30 @@ int main(int argc, char* argv[]) {
         cout << endl;
         cout << "    -T, --threads \t The number of threads to spawn (default is all)" << endl;
         cout << endl;
+        cout << "    -E, --sort    \t Count k-mers by sorting buffered (k-mer, genome) pairs instead of hashing" << endl;
+        cout << "                  \t (sequential memory access, but all k-mer occurrences are kept until sorted)" << endl;
+        cout << endl;
+        cout << "    -Y, --max-memory\t Limit the memory for buffering and sorting k-mers to the given number of gigabytes" << endl;
+        cout << "                  \t by spilling them to disk (implies --sort, the color table comes on top)" << endl;
+        cout << "                  \t optional: directory for the temporary files (default: $TMPDIR or /tmp)" << endl;
+        cout << endl;
+        cout << "    -Q, --qualify-sorted\t Count the coverage for --qualify while sorting (implies --sort)" << endl;
+        cout << "                  \t (per genome; with --max-memory, memory is bounded regardless of coverage)" << endl;
+        cout << endl;
+        cout << "    -U, --superkmer\t Select the bins of the k-mers by their minimizers of the given length" << endl;
+        cout << "                  \t (runs of consecutive k-mers share a bin and are inserted together)" << endl;
+        cout << endl;
+        cout << "    -K, --sketch  \t Estimate the coverage for --qualify by a count-min sketch per thread" << endl;
+        cout << "                  \t (erroneous k-mers are not stored, but may rarely pass the threshold)" << endl;
+        cout << "                  \t optional: the total size of all sketches in megabytes (default: 1024)" << endl;
+        cout << "                  \t each sketch is sized by its input file, but at most 1 GB per thread" << endl;
+        cout << endl;
+        cout << "    -D, --dedup   \t Pass each k-mer to the shared tables only once per input file" << endl;
+        cout << "                  \t (recommended for read data, filters repeated occurrences per thread)" << endl;
+        cout << endl;
+        cout << "    -G, --per-genome\t Count the coverage for --qualify per genome across all of its files" << endl;
+        cout << "                  \t (e.g. paired reads, counters are shared by the threads and capped at 255)" << endl;
+        cout << endl;
         cout << "    -h, --help    \t Display this help page and quit" << endl;
         cout << endl;
         cout << "  Contact: pangenomics-service@cebitec.uni-bielefeld.de" << endl;
@@ -161,6 +205,7 @@ int main(int argc, char* argv[]) {
     string graph_filter;    // name of graph filter file
     string splits;    // name of splits file
     string blacklistfile; // name of blacklist file
+    string blacklistindex; // name of blacklist index file to be written
     string output;    // name of output file
     string newick;    // name of newick output file // Todo
     string nexus;   // name of nexus output file
@@ -184,16 +229,23 @@ int main(int argc, char* argv[]) {
     bool userKmer = false; // is k-mer default or custom
     uint64_t kmer = 31;    // length of k-mers
     uint64_t window = 1;    // number of k-mers in a minimizer window
+    uint64_t scaled = 1;    // keep one in so many k-mers (FracMinHash)
+    uint64_t syncmer = 0;    // length of the s-mers deciding the syncmers (0: all k-mers)
+    bool closed_syncmer = true;    // closed instead of open syncmers
+    uint64_t superkmer = 0;    // length of the minimizers selecting the bins (0: bins by k-mer hash)
 
     // kmer preprocessing and filtering
     bool reverse = true;    // consider reverse complement k-mers
     uint64_t iupac = 1;    // allow extended iupac characters
     int quality = 1;    // min. coverage threshold for k-mers (if individual q values per file are given, this is the maximum among all)
+    bool auto_quality = false;    // choose the coverage threshold per genome from its k-mer spectrum
 
     // amino processing
     bool amino = false;      // input files are amino acid sequences
     bool shouldTranslate = false;   // translate input files
     uint64_t code = 1;
+    bool six_frame = false;    // translate input files in all six reading frames
+    bool frame_stops = false;    // break the six-frame k-mers at stop codons
 
     // split processing
     auto mean = util::geometric_mean2;    // weight function
@@ -205,6 +257,14 @@ int main(int argc, char* argv[]) {
 
     // parallel hashing
     uint64_t threads = thread::hardware_concurrency(); // The number of threads to run on (default is #cores including smt / ht)
+    bool sorting = false; // count k-mers by sorting instead of hashing
+    bool dedup = false; // pass each k-mer only once per input file
+    bool sketch = false; // estimate the coverage by a count-min sketch
+    double sketch_memory = 1024; // the total size of all sketches in megabytes
+    bool per_genome = false; // count the coverage per genome instead of per file
+    bool sort_qualify = false; // count the coverage while sorting
+    double max_memory = 0; // memory limit for buffering k-mers in gigabytes (0 = unlimited)
+    string bucket_dir = getenv("TMPDIR") != nullptr ? getenv("TMPDIR") : "/tmp"; // directory for spilled k-mers
 
     // bootsrapping
     string consensus_filter; // filter function for filtering after bootstrapping
@@ -288,6 +348,10 @@ int main(int argc, char* argv[]) {
             catch_missing_dependent_args(argv[i + 1], argv[i]);
             blacklistfile = argv[++i];    // Blacklist file: load kmers to be ignored
         }
+        else if (strcmp(argv[i], "-J") == 0 || strcmp(argv[i], "--blacklist-index") == 0) {
+            catch_missing_dependent_args(argv[i + 1], argv[i]);
+            blacklistindex = argv[++i];    // Blacklist index file: write the blacklist k-mers for later runs
+        }
         else if (strcmp(argv[i], "-o") == 0 || strcmp(argv[i], "--output") == 0) {
             catch_missing_dependent_args(argv[i + 1], argv[i]);
             output = argv[++i];    // Output file: list of splits, sorted by weight desc.
@@ -369,11 +433,25 @@ int main(int argc, char* argv[]) {
             kmer = stoi(argv[++i]);    // Length of k-mers (default: 31, 10 for amino acids)
             userKmer = true;
         }
+        else if (strcmp(argv[i], "-y") == 0 || strcmp(argv[i], "--syncmer") == 0) {
+            catch_missing_dependent_args(argv[i + 1], argv[i]);
+            catch_failed_stoi_cast(argv[i + 1], argv[i]);
+            syncmer = stoi(argv[++i]);    // Length of the s-mers
+            if (i+1 < argc && (strcmp(argv[i+1], "open") == 0 || strcmp(argv[i+1], "closed") == 0)) {
+                closed_syncmer = strcmp(argv[++i], "closed") == 0;
+            }
+        }
+        else if (strcmp(argv[i], "-F") == 0 || strcmp(argv[i], "--scaled") == 0) {
+            catch_missing_dependent_args(argv[i + 1], argv[i]);
+            catch_failed_stoi_cast(argv[i + 1], argv[i]);
+            scaled = stoi(argv[++i]);    // Keep one in so many k-mers
+            if (scaled < 1) {
+                cerr << "Error: --scaled must be at least 1" << endl;
+                return 1;
+            }
+        }
         else if (strcmp(argv[i], "-w") == 0 || strcmp(argv[i], "--window") == 0) {
             window = stoi(argv[++i]);    // Number of k-mers (default: 1)
-            if (window > 1) {
-                cerr << "Warning: using experimental feature --window" << endl;
-            }
         }
         else if (strcmp(argv[i], "-t") == 0 || strcmp(argv[i], "--top") == 0) {
             catch_missing_dependent_args(argv[i + 1], argv[i]);
@@ -445,8 +523,13 @@ int main(int argc, char* argv[]) {
         }
         else if (strcmp(argv[i], "-q") == 0 || strcmp(argv[i], "--qualify") == 0) {
             catch_missing_dependent_args(argv[i + 1], argv[i]);
-            catch_failed_stoi_cast(argv[i + 1], argv[i]);
-            quality = stoi(argv[++i]);    // Discard k-mers below a min. coverage threshold
+            if (strcmp(argv[i + 1], "auto") == 0) {
+                auto_quality = true;    // Choose the threshold per genome from its k-mer spectrum
+                ++i;
+            } else {
+                catch_failed_stoi_cast(argv[i + 1], argv[i]);
+                quality = stoi(argv[++i]);    // Discard k-mers below a min. coverage threshold
+            }
         }
         else if (strcmp(argv[i], "-p") == 0 || strcmp(argv[i], "--pdf") == 0) {
             catch_missing_dependent_args(argv[i + 1], argv[i]);
@@ -493,6 +576,14 @@ int main(int argc, char* argv[]) {
             }
             shouldTranslate = true;
         }
+        else if (strcmp(argv[i], "-6") == 0 || strcmp(argv[i], "--six-frame") == 0) {
+            if (i+1 < argc && strcmp(argv[i+1], "stop") == 0) {
+                frame_stops = true;    // Break the k-mers at stop codons
+                i++;
+            }
+            shouldTranslate = true;
+            six_frame = true;
+        }
         // parallelization 
         else if (strcmp(argv[i], "-T") == 0 || strcmp(argv[i], "--threads") == 0){ 
             catch_missing_dependent_args(argv[i + 1], argv[i]);
@@ -510,6 +601,56 @@ int main(int argc, char* argv[]) {
                 if (!ask_for_user_confirmation()){return 0;}
             }
         }
+        else if (strcmp(argv[i], "-E") == 0 || strcmp(argv[i], "--sort") == 0) {
+            sorting = true;    // Count k-mers by sorting instead of hashing
+        }
+        else if (strcmp(argv[i], "-Y") == 0 || strcmp(argv[i], "--max-memory") == 0) {
+            catch_missing_dependent_args(argv[i + 1], argv[i]);
+            try {
+                max_memory = std::stod(argv[++i]);
+            } catch (const std::exception& e) {
+                cerr << "Error: Could not read memory limit: " << argv[i] << endl;
+                exit(1);
+            }
+            if (max_memory <= 0) {
+                cerr << "Error: memory limit must be positive." << endl;
+                exit(1);
+            }
+            if (i+1 < argc && argv[i+1][0]!='-') { // optional directory for the spilled k-mers
+                bucket_dir = argv[++i];
+            }
+            sorting = true;    // External buckets are reduced by sorting
+        }
+        else if (strcmp(argv[i], "-Q") == 0 || strcmp(argv[i], "--qualify-sorted") == 0) {
+            sort_qualify = true;    // Count the coverage while sorting
+            sorting = true;
+        }
+        else if (strcmp(argv[i], "-U") == 0 || strcmp(argv[i], "--superkmer") == 0) {
+            catch_missing_dependent_args(argv[i + 1], argv[i]);
+            catch_failed_stoi_cast(argv[i + 1], argv[i]);
+            superkmer = stoi(argv[++i]);    // Length of the minimizers selecting the bins
+        }
+        else if (strcmp(argv[i], "-K") == 0 || strcmp(argv[i], "--sketch") == 0) {
+            sketch = true;    // Estimate the coverage by a count-min sketch
+            if (i+1 < argc && isdigit(argv[i+1][0])) { // optional memory budget for all sketches
+                try {
+                    sketch_memory = std::stod(argv[++i]);
+                } catch (const std::exception& e) {
+                    cerr << "Error: Could not read sketch size: " << argv[i] << endl;
+                    exit(1);
+                }
+                if (sketch_memory <= 0) {
+                    cerr << "Error: sketch size must be positive." << endl;
+                    exit(1);
+                }
+            }
+        }
+        else if (strcmp(argv[i], "-D") == 0 || strcmp(argv[i], "--dedup") == 0) {
+            dedup = true;    // Pass each k-mer only once per input file
+        }
+        else if (strcmp(argv[i], "-G") == 0 || strcmp(argv[i], "--per-genome") == 0) {
+            per_genome = true;    // Count the coverage per genome
+        }
         // bootsrapping
         else if (strcmp(argv[i], "-b") == 0 || strcmp(argv[i], "--bootstrapping") == 0 || strcmp(argv[i], "--bootstrap") == 0) {
             catch_missing_dependent_args(argv[i + 1], argv[i]);
@@ -607,7 +748,12 @@ int main(int argc, char* argv[]) {
         return 1;
     }
     
-    if (input.empty() && graph.empty()) {
+    if (!blacklistindex.empty() && blacklistfile.empty()) {
+        cerr << "Error: missing argument --blacklist <file_name> for option --blacklist-index" << endl;
+        return 1;
+    }
+    bool index_only = !blacklistindex.empty() && input.empty() && graph.empty();    // only build the blacklist index
+    if (input.empty() && graph.empty() && !index_only) {
         cerr << "Error: missing argument: --input <file_name> or --graph <file_name>" << endl;
         return 1;
     }
@@ -621,7 +767,7 @@ int main(int argc, char* argv[]) {
         return 1;
     }
 
-    if (input.empty() && amino) {
+    if (input.empty() && amino && !index_only) {
         cerr << "Error: missing argument: --input <file_name> for option --amino" << endl;
         return 1;
     }
@@ -633,8 +779,12 @@ int main(int argc, char* argv[]) {
         cerr << "Error: too many input arguments: --graph and --amino" << endl;
         return 1;
     }
+    if (!graph.empty() && sorting) {
+        cerr << "Error: --sort and --max-memory are only applicable to sequence input (--input), not in combination with --graph" << endl;
+        return 1;
+    }
 
-    if (output.empty() && newick.empty() && nexus.empty() && pdf.empty() && svg.empty() && core.empty() && !raw_wanted && stats.empty()) {
+    if (output.empty() && newick.empty() && nexus.empty() && pdf.empty() && svg.empty() && core.empty() && !raw_wanted && stats.empty() && !index_only) {
         cerr << "Error: missing argument: --output <file_name> or --newick <file_name> or --nexus <file_name> or --pdf <file_name> or --svg <file_name> or --core <file_name> or --raw <file_name> or --stats <file_name>" << endl;
         return 1;
     }
@@ -686,8 +836,15 @@ int main(int argc, char* argv[]) {
         else if (window > 1) {
             cerr << "Warning: input from graph with --window can produce unexpected results" << endl;
         }
-    } else if (quality > 1 && window > 1) {
-        cerr << "Warning: using --qualify with --window could produce unexpected results" << endl;
+    }
+
+    if (scaled > 1 && window > 1) {
+        cerr << "Error: --scaled cannot be combined with --window" << endl;
+        return 1;
+    }
+    if (auto_quality && shouldTranslate) {
+        cerr << "Error: --qualify auto cannot be combined with --code or --six-frame" << endl;
+        return 1;
     }
 
     if (!input.empty() && !splits.empty()) {
@@ -726,6 +883,30 @@ int main(int argc, char* argv[]) {
     }
     // deduct default kmer size if not user defined
     if (!userKmer) {kmer = amino == true ? 10 : 31;}
+    if (superkmer > 0) {
+        if (amino) {
+            cerr << "Error: --superkmer is only applicable to nucleotide k-mers" << endl;
+            return 1;
+        }
+        if (superkmer >= kmer || superkmer > 32) {
+            cerr << "Error: the minimizers of --superkmer must be shorter than the k-mers (and at most 32)" << endl;
+            return 1;
+        }
+    }
+    if (syncmer > 0) {
+        if (amino) {
+            cerr << "Error: --syncmer is only applicable to nucleotide k-mers" << endl;
+            return 1;
+        }
+        if (syncmer >= kmer || syncmer > 32) {
+            cerr << "Error: the s-mers of --syncmer must be shorter than the k-mers (and at most 32)" << endl;
+            return 1;
+        }
+        if (window > 1 || iupac > 1) {
+            cerr << "Error: --syncmer cannot be combined with --window or --iupac" << endl;
+            return 1;
+        }
+    }
 
 
     /**
@@ -1054,7 +1235,7 @@ int main(int argc, char* argv[]) {
         cerr << "Solution: modify -DmaxN in makefile, run make, run SANS; or use SANS-autoN.sh." << endl;
         return 1;
     }
-    if (maxN-num>=100) {
+    if (maxN-num>=100 && !index_only) {
 		cout << "Warning: number of input genomes ("<<num<<") much lower than -DmaxN=" << maxN << endl;
 		cout << "Recommendation: modify -DmaxN in makefile, run make, run SANS; or use SANS-autoN.sh." << endl;
 	}
@@ -1083,68 +1264,262 @@ int main(int argc, char* argv[]) {
     }else{
         graph::init_count(top, amino, q_table, quality, blacklist, blacklist_amino, threads); // initialize the toplist size and the allowed characters
     }
+    if (scaled > 1) {
+        graph::activate_scaled(scaled); // keep only a FracMinHash sample of the k-mers
+    }
+    if (superkmer > 0) {
+        graph::activate_superkmers(superkmer, threads); // select the bins by minimizers
+    }
+    if (syncmer > 0) {
+        graph::activate_syncmers(syncmer, closed_syncmer, reverse, threads); // keep only the syncmers of the k-mers
+    }
+    if (iupac > 1) {
+        graph::activate_iupac(threads); // resolve the ambiguous characters
+    }
+
+    /**
+     * [spectrum sampling]
+     * - count the occurrences of a sample of each genome's k-mers and choose its coverage threshold
+     * - this is an extra pass over all input files, the thresholds are needed before the k-mers are counted
+     */
+    vector<vector<uint64_t>> spectra(denom_file_count);    // the sampled k-mer spectrum per genome
+    if (auto_quality && !input.empty() && splits.empty()) {
+        if (verbose) {
+            cout << "Sampling k-mer spectra..." << flush;
+        }
+        uint64_t index = 0;
+        std::mutex index_mutex;
+        auto index_lambda = [&] () { std::lock_guard<mutex> lg(index_mutex); return index++;};
+
+        auto lambda = [&] () { // This lambda expression samples the k-mers of one genome after the other
+            for (uint64_t g = index_lambda(); g < gen_files.size(); g = index_lambda()) {
+                hash_map<kmer_t, uint8_t> counts;
+                hash_map<kmerAmino_t, uint8_t> counts_amino;
+                string sequence;
+                auto sample = [&] () { amino ? graph::sample_kmers(sequence, counts_amino) : graph::sample_kmers(sequence, counts, reverse); sequence.clear(); };
+                for (string file_name : gen_files[g]) {
+                    if (file_name[0]!='/') { //no absolute path?
+                        file_name=folder+file_name;
+                    }
+                    igzstream file(file_name.c_str(), ios::in);
+                    string line;
+                    while (getline(file, line)) {
+                        if (line.length() == 0) continue;
+                        if (line[0] == '>' || line[0] == '@') {    // FASTA & FASTQ header -> sample the previous sequence
+                            sample();
+                        } else if (line[0] == '+') {    // FASTQ quality values -> ignore
+                            getline(file, line);
+                        } else {
+                            transform(line.begin(), line.end(), line.begin(), ::toupper);
+                            sequence += line;
+                        }
+                    }
+                    sample();
+                    file.close();
+                }
+                spectra[g] = amino ? graph::spectrum(counts_amino) : graph::spectrum(counts);
+            }
+        };
+        vector<thread> thread_holder(threads);
+        for (uint64_t thread_id = 0; thread_id < threads; ++thread_id){thread_holder[thread_id] = thread(lambda);}
+        for (uint64_t thread_id = 0; thread_id < threads; ++thread_id){thread_holder[thread_id].join();}
+
+        // choose the thresholds, given ones are replaced
+        q_table.clear();
+        for (auto& histogram : spectra) q_table.push_back(graph::spectrum_threshold(histogram));
+        quality = q_table.empty() ? 1 : *max_element(q_table.begin(), q_table.end());
+        if (q_table.empty() || *min_element(q_table.begin(), q_table.end()) == quality) {q_table.clear();} // all q_values the same (=quality)
+        graph::set_quality(q_table, quality, threads);
+
+        if (verbose) {
+            end = chrono::high_resolution_clock::now();
+            cout << "\33[2K\r" << "Sampling k-mer spectra... (" << util::format_time(end - begin) << ")" << endl;
+            for (uint64_t g = 0; g < spectra.size(); ++g) {
+                cout << denom_names[g] << ": q=" << (q_table.empty() ? quality : q_table[g]) << endl;
+            }
+        }
+    }
+
+    if (max_memory > 0) {
+        uint64_t input_size = 0; // at most one k-mer per input byte and resolution
+        for (auto& files : gen_files) {
+            for (auto file_name : files) {
+                if (file_name[0] != '/') file_name = folder + file_name;
+                input_size += util::input_size(file_name);
+            }
+        }
+        if (iupac > 1) input_size *= iupac;    // up to iupac resolved k-mers per position
+        if (six_frame) input_size *= 2;    // six frames, each a third of the bases long
+        if (!graph::activate_external(threads, max_memory * 1e9, bucket_dir, input_size)) { // spill the buffered k-mers to disk
+            cerr << "Error: could not create temporary directory in " << bucket_dir << endl;
+            return 1;
+        }
+    } else if (sorting) {
+        graph::activate_sorting(threads); // buffer the k-mers for sorting instead of hashing them
+    }
+    if (sort_qualify) {
+        if (quality < 2) {
+            cerr << "Error: --qualify-sorted is only applicable in combination with --qualify (q > 1)" << endl;
+            return 1;
+        }
+        if (dedup || sketch || per_genome) {
+            cerr << "Error: --qualify-sorted cannot be combined with --dedup, --sketch or --per-genome" << endl;
+            return 1;
+        }
+        graph::activate_sort_counting(); // buffer all occurrences, the threshold is applied after sorting
+    }
+    if (dedup) {
+        graph::activate_dedup(threads); // filter repeated k-mers per input file before the shared tables
+    }
+    if (sketch) {
+        if (quality < 2) {
+            cerr << "Error: --sketch is only applicable in combination with --qualify (q > 1)" << endl;
+            return 1;
+        }
+        graph::activate_sketch(threads, sketch_memory*1024*1024); // estimate the coverage before storing k-mers
+    }
+    if (per_genome) {
+        if (quality < 2) {
+            cerr << "Error: --per-genome is only applicable in combination with --qualify (q > 1)" << endl;
+            return 1;
+        }
+        if (sketch) {
+            cerr << "Error: --per-genome cannot be combined with --sketch" << endl;
+            return 1;
+        }
+        vector<uint32_t> file_counts;
+        for (auto& files : gen_files) file_counts.push_back(files.size());
+        graph::activate_genome_counting(file_counts); // share the counters of a genome among its files
+    }
         
 
 	
 	/**
 	 * Read blacklist
 	 */
-	if(!blacklistfile.empty()){
+	if(!blacklistfile.empty() && graph::is_blacklist_index(blacklistfile)){
+        if (!blacklistindex.empty()) {
+            cerr << "Error: --blacklist is already an index: " << blacklistfile << endl;
+            return 1;
+        }
+        if (verbose) {
+            cout << "Mapping blacklist index... " << flush;
+        }
+        if (!graph::load_blacklist(blacklistfile, reverse)) {
+            return 1;
+        }
+        if (verbose) {
+            cout << graph::size_blacklist() << " k-mers indexed." << endl << flush;
+        }
+		graph::activate_blacklist();
+	}
+	else if(!blacklistfile.empty()){
 
         if (verbose) {
             cout << "Reading blacklist file... " << flush;
         }
  
+        // the records are read here and passed in batches to the threads, which extract their k-mers in parallel
+        const uint64_t batch_size = 1 << 20;    // bases per batch, longer records are cut into pieces overlapping by k-1 bases
+        deque<vector<string>> batches;    // the batches waiting for a thread
+        std::mutex batch_mutex;
+        condition_variable batch_ready, batch_taken;
+        bool reading = true;
+        count::deleteCount();
+
+        auto lambda_blacklist = [&] () {
+            for (;;) {
+                vector<string> batch;
+                {
+                    unique_lock<mutex> lg(batch_mutex);
+                    batch_ready.wait(lg, [&] () {return !batches.empty() || !reading;});
+                    if (batches.empty()) return;    // all records are processed
+                    batch = move(batches.front());
+                    batches.pop_front();
+                }
+                batch_taken.notify_one();
+                for (string& sequence : batch) {
+                    if (shouldTranslate) sequence = six_frame ? translator::translateFrames(sequence, frame_stops) : translator::translate(sequence);    // translate the whole record, codons may span lines
+                    graph::fill_blacklist(sequence, reverse);
+                }
+            }
+        };
+        vector<thread> thread_holder(threads);
+        for (uint64_t thread_id = 0; thread_id < threads; ++thread_id){thread_holder[thread_id] = thread(lambda_blacklist);}
+
+        vector<string> batch;    // the batch being filled
+        uint64_t batch_bases = 0;
+        auto pass_batch = [&] () {    // hand the batch over, wait while the threads are busy
+            unique_lock<mutex> lg(batch_mutex);
+            batch_taken.wait(lg, [&] () {return batches.size() < 2 * threads;});
+            batches.push_back(move(batch));
+            lg.unlock();
+            batch_ready.notify_one();
+            batch.clear();
+            batch_bases = 0;
+        };
+        auto pass_sequence = [&] (string& sequence) {
+            if (sequence.empty()) return;
+            batch_bases += sequence.length();
+            batch.push_back(move(sequence));
+            sequence.clear();
+            if (batch_bases >= batch_size) pass_batch();
+        };
+
         string sequence;    // read in the sequence files and extract the k-mers
 		char c_name[(blacklistfile).length()+1]; // Create char array for c compatibilty
 		strcpy(c_name, (blacklistfile).c_str()); // Transcire to char array
 
 		igzstream file(c_name, ios::in);    // input file stream
-				count::deleteCount();
-
-				string appendixChars; 
 				string line;    // read the file line by line
 				while (getline(file, line)) {
 					if (line.length() > 0) {
 						if (line[0] == '>' || line[0] == '@') {    // FASTA & FASTQ header -> process
-							graph::fill_blacklist(sequence, reverse);
-							sequence.clear();
+							pass_sequence(sequence);
 						}
 						else if (line[0] == '+') {    // FASTQ quality values -> ignore
 							getline(file, line);
 						}
 						else {
 							transform(line.begin(), line.end(), line.begin(), ::toupper);
-							string newLine = line;
-							if (shouldTranslate) {
-								if (appendixChars.length() >0 ) {
-									newLine= appendixChars + newLine;
-									appendixChars = "";
-								}
-								auto toManyChars = line.length() % 3;
-								if (toManyChars > 0) {
-									appendixChars = newLine.substr(line.length() - toManyChars, toManyChars);
-									newLine = newLine.substr(0, line.length() - toManyChars);
-								}
-								newLine = translator::translate(newLine);
+							sequence += line;    // FASTA & FASTQ sequence -> read
+							if (!shouldTranslate && sequence.length() >= batch_size) {    // pass a piece of a long record, records to be translated stay whole
+								string overlap = sequence.substr(sequence.length() - (kmer - 1));
+								pass_sequence(sequence);
+								sequence = overlap;
 							}
-							sequence += newLine;    // FASTA & FASTQ sequence -> read
 						}
 					}
 				}
-				if (verbose && count::getCount() > 0) {
-					cerr << count::getCount()<< " triplets could not be translated while reading blacklist."<< endl;
-				}
-				graph::fill_blacklist(sequence, reverse);
-				sequence.clear();
-
+				pass_sequence(sequence);
 				file.close();
+
+        if (!batch.empty()) pass_batch();
+        {
+            std::lock_guard<mutex> lg(batch_mutex);
+            reading = false;
+        }
+        batch_ready.notify_all();
+        for (uint64_t thread_id = 0; thread_id < threads; ++thread_id){thread_holder[thread_id].join();}
+        if (verbose && count::getCount() > 0) {
+            cerr << count::getCount()<< " triplets could not be translated while reading blacklist."<< endl;
+        }
        if (verbose) {
             cout << graph::size_blacklist() << " k-mers read." << endl << flush;
         }
         if (graph::size_blacklist()==0){
 			cerr << "Warning: Blacklist provided, but no k-mers read." << endl << flush;
 		}
+		if (!blacklistindex.empty()) {
+			if (!graph::save_blacklist(blacklistindex, reverse)) {
+				cerr << "Error: could not write blacklist index: " << blacklistindex << endl;
+				return 1;
+			}
+			if (verbose) {
+				cout << "Blacklist index written to " << blacklistindex << endl << flush;
+			}
+			if (index_only) return 0;
+		}
 		graph::activate_blacklist();
 	}
 
@@ -1219,6 +1594,12 @@ int main(int argc, char* argv[]) {
 				strcpy(c_name, (file_name).c_str()); // Transcire to char array
 
 				igzstream file(c_name, ios::in);    // input file stream
+				if (per_genome) { // the counters of the genome are shared with the threads reading its other files
+					graph::begin_genome_file(genome_ids[i]);
+				}
+				if (sketch) { // size the sketch of the thread by the input file
+					graph::reset_sketch(T, util::input_size(file_name));
+				}
 				if (verbose) {     // print progress
 // 					cout << "\33[2K\r" << file_name;
 					if (q_table.size()>0) {
@@ -1234,19 +1615,27 @@ int main(int argc, char* argv[]) {
 				count::deleteCount();
 
 
-				string appendixChars; 
+				auto add_sequence = [&] () {
+					if (shouldTranslate && window <= 1 && iupac <= 1) {    // translate while extracting the k-mers
+						six_frame ? graph::add_frames(T, sequence, genome_ids[i], frame_stops)
+								: graph::add_codons(T, sequence, genome_ids[i]);
+						return;
+					}
+					if (shouldTranslate) sequence = six_frame ? translator::translateFrames(sequence, frame_stops) : translator::translate(sequence);    // translate the whole record, codons may span lines
+					if (window > 1) {
+						iupac > 1 ? graph::add_minimizers(T, sequence, genome_ids[i], reverse, window, iupac)
+								: graph::add_minimizers(T, sequence, genome_ids[i], reverse, window);
+					} else {
+						iupac > 1 ? graph::add_kmers(T, sequence, genome_ids[i], reverse, iupac)
+								: graph::add_kmers(T, sequence, genome_ids[i], reverse);
+					}
+				};
+
 				string line;    // read the file line by line
 				while (getline(file, line)) {
 					if (line.length() > 0) {
 						if (line[0] == '>' || line[0] == '@') {    // FASTA & FASTQ header -> process
-							if (window > 1) {
-								iupac > 1 ? graph::add_minimizers(T, sequence, genome_ids[i], reverse, window, iupac)
-										: graph::add_minimizers(T, sequence, genome_ids[i], reverse, window);
-							} else {
-								iupac > 1 ? graph::add_kmers(T, sequence, genome_ids[i], reverse, iupac)
-										: graph::add_kmers(T, sequence, genome_ids[i], reverse);
-							}
-
+							add_sequence();
 							sequence.clear();
 
 //                            if (verbose) {
@@ -1258,35 +1647,15 @@ int main(int argc, char* argv[]) {
 						}
 						else {
 							transform(line.begin(), line.end(), line.begin(), ::toupper);
-							string newLine = line;
-							if (shouldTranslate) {
-								if (appendixChars.length() >0 ) {
-									newLine= appendixChars + newLine;
-									appendixChars = "";
-								}
-								auto toManyChars = line.length() % 3;
-								if (toManyChars > 0) {
-									appendixChars = newLine.substr(line.length() - toManyChars, toManyChars);
-									newLine = newLine.substr(0, line.length() - toManyChars);
-								}
-
-								newLine = translator::translate(newLine);
-							}
-							sequence += newLine;    // FASTA & FASTQ sequence -> read
+							sequence += line;    // FASTA & FASTQ sequence -> read
 						}
 					}
 				}
+				add_sequence();
+				sequence.clear();
 				if (verbose && count::getCount() > 0) {
 					cerr << count::getCount()<< " triplets could not be translated."<< endl;
 				}
-				if (window > 1) {
-					iupac > 1 ? graph::add_minimizers(T, sequence, genome_ids[i], reverse, window, iupac)
-							: graph::add_minimizers(T, sequence, genome_ids[i], reverse, window);
-				} else {
-					iupac > 1 ? graph::add_kmers(T, sequence, genome_ids[i], reverse, iupac)
-							: graph::add_kmers(T, sequence, genome_ids[i], reverse);
-				}
-				sequence.clear();
 
 				
 // 				if (verbose) {
@@ -1294,6 +1663,9 @@ int main(int argc, char* argv[]) {
 // 				}
 				file.close();
                 graph::clear_thread(T);
+                if (per_genome) {
+                    graph::end_genome_file(genome_ids[i]);
+                }
                 i = index_lambda();
             }
         }; // End of lambda expression
@@ -1310,8 +1682,17 @@ int main(int argc, char* argv[]) {
 		vector<thread> thread_holder(threads);
         for (uint64_t thread_id = 0; thread_id < threads; ++thread_id){thread_holder[thread_id] = thread(lambda, thread_id, genome_ids, file_ids);}
         for (uint64_t thread_id = 0; thread_id < threads; ++thread_id){thread_holder[thread_id].join();}
-        
 
+        if (sorting) {
+            if (verbose) {
+                cout << "Sorting k-mers..." << flush;
+            }
+            graph::sort_kmers(threads, !core.empty(), verbose);    // reduce the sorted k-mers into the color table
+            if (verbose) {
+                end = chrono::high_resolution_clock::now();
+                cout << "\33[2K\r" << "Sorting k-mers... (" << util::format_time(end - begin) << ")" << endl;
+            }
+        }
     }
 
     /**
@@ -1369,6 +1750,21 @@ double min_value = numeric_limits<double>::min(); // current minimal weight repr
 		uint64_t all=s+graph::number_kmers();
 		end = chrono::high_resolution_clock::now(); 
 		cout << all << " k-mers read." << " (" << s << " / "<< (100*s/all) <<"% singleton k-mers)" << " (" << util::format_time(end - begin) << ")" << endl << flush;
+		graph::print_bin_statistics(cout);
+	}
+
+	// the tables are only read from now on
+	if (!sorting && ((!input.empty() && splits.empty()) || !graph.empty())) {
+		// without core k-mers, the tables are consumed into the color table right away
+		string step = core.empty() ? "Consuming k-mer tables..." : "Freezing k-mer tables...";
+		if (verbose) {
+			cout << step << flush;
+		}
+		graph::freeze_tables(!core.empty(), threads, verbose);
+		if (verbose) {
+			end = chrono::high_resolution_clock::now();
+			cout << "\33[2K\r" << step << " (" << util::format_time(end - begin) << ")" << endl;
+		}
 	}
 
     // write kmer statistics
@@ -1396,7 +1792,12 @@ double min_value = numeric_limits<double>::min(); // current minimal weight repr
                 uint64_t s=graph::number_singleton_kmers(i);
                 double z = (static_cast<double>(a) - mu) / sigma;
                 if (abs(z)>abs(max_z)){max_z=z;}
-				stream_stats << denom_names[i] << "\t" << a << "\t" << s << "\t" << z << endl;
+				stream_stats << denom_names[i] << "\t" << a << "\t" << s << "\t" << z;
+				if (auto_quality) { // the chosen threshold and the sampled spectrum
+					stream_stats << "\t" << (q_table.empty() ? quality : q_table[i]) << "\t";
+					for (uint64_t c = 1; c < spectra[i].size(); ++c) stream_stats << (c > 1 ? "," : "") << spectra[i][c];
+				}
+				stream_stats << endl;
         }
 		
 		file_stats.close();
@@ -1463,7 +1864,7 @@ double min_value = numeric_limits<double>::min(); // current minimal weight repr
 		if (verbose) {
 			cout << "Accumulating splits from non-singleton k-mers..."  << flush;
 		}
-		graph::add_weights(mean, min_value, verbose);  // accumulate split weights
+		graph::add_weights(mean, min_value, threads, verbose);  // accumulate split weights
 		if (verbose) {
 			end = chrono::high_resolution_clock::now();
 			cout << "\33[2K\r" << "Accumulating splits from non-singleton k-mers... (" << util::format_time(end - begin) << ")" << endl;
@@ -1487,7 +1888,7 @@ double min_value = numeric_limits<double>::min(); // current minimal weight repr
 		if (verbose) {
 			cout << "Compile split list..."  << flush;
 		}
-		graph::compile_split_list(mean, min_value);
+		graph::compile_split_list(mean, min_value, threads);
 		if (verbose) {
 			end = chrono::high_resolution_clock::now();
 			cout << " (" << util::format_time(end - begin) << ")" << endl;
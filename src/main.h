@@ -5,6 +5,8 @@
 #include <thread>
 #include <regex>
 #include <mutex>
+#include <condition_variable>
+#include <deque>
 
 #include "util.h"
 #include "translator.h"
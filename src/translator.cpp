@@ -78,6 +78,9 @@ struct translationTable {
 };
 struct translationTable translator::translationTable = {};
 unordered_set<char> translator::bases;
+uint8_t translator::baseMasks[256];
+char translator::aminoTable[4096];
+uint8_t translator::codeTable[4096];
 const char* translationTable::bases[] = {"TTTTTTTTTTTTTTTTCCCCCCCCCCCCCCCCAAAAAAAAAAAAAAAAGGGGGGGGGGGGGGGG",
                                          "TTTTCCCCAAAAGGGGTTTTCCCCAAAAGGGGTTTTCCCCAAAAGGGGTTTTCCCCAAAAGGGG",
                                          "TCAGTCAGTCAGTCAGTCAGTCAGTCAGTCAGTCAGTCAGTCAGTCAGTCAGTCAGTCAGTCAG"};
@@ -116,6 +119,7 @@ bool translator::init(uint64_t& id) {
             } else if (to.rfind('}', 0) == 0) {
                 if (currentTranslationable.id == id) {
                     translator::translationTable = currentTranslationable;
+                    translator::createTables();
                     found = true;
                 }
             }
@@ -175,11 +179,76 @@ bool translator::isBase(char &base) {
     return got != translator::bases.end();
 }
 
+void translator::createTables() {
+    const string iupac = "ACGTRYSWKMBDHVN";
+    const uint8_t masks[] = {1, 2, 4, 8, 1|4, 2|8, 2|4, 1|8, 4|8, 1|2, 2|4|8, 1|4|8, 1|2|8, 1|2|4, 1|2|4|8};
+    fill(begin(baseMasks), end(baseMasks), 0);
+    for (int i = 0; i < iupac.length(); i++) {
+        baseMasks[(uint8_t) iupac[i]] = masks[i];
+    }
+
+    const string nucleotides = "ACGT";
+    for (uint16_t key = 0; key < 4096; key++) {
+        string acids;    // the distinct amino acids of all resolutions of the codon
+        bool valid = (key >> 8 & 15) && (key >> 4 & 15) && (key & 15);
+        for (int a = 0; a < 4 && valid; a++) {
+            for (int b = 0; b < 4 && valid; b++) {
+                for (int c = 0; c < 4 && valid; c++) {
+                    if (!(key >> 8 & 1 << a) || !(key >> 4 & 1 << b) || !(key & 1 << c)) continue;
+                    string triplet = {nucleotides[a], nucleotides[b], nucleotides[c]};
+                    codon codon = translationTable[triplet];
+                    valid = codon.isValid();
+                    if (valid && acids.find(codon.amino[0]) == string::npos) acids += codon.amino;
+                }
+            }
+        }
+        sort(acids.begin(), acids.end());
+        char amino = 'X';
+        if (valid && acids.length() == 1) amino = acids[0];
+        else if (valid && acids == "DN") amino = 'B';
+        else if (valid && acids == "EQ") amino = 'Z';
+        else if (valid && acids == "IL") amino = 'J';
+        aminoTable[key] = amino;
+        codeTable[key] = acids.length() == 1 && valid ? util::amino_char_to_bits(amino) : untranslated;
+    }
+}
+
 string translator::translate(string &line) {
     string translated;
-    for (auto pos = 0; pos+3 <= line.length(); pos = pos +3) {
-        string unit = line.substr(pos, 3);
-        translated+= translator::getTranslatedAminoAcid(unit);
+    translated.reserve(line.length() / 3);
+    for (uint64_t pos = 0; pos+3 <= line.length(); pos = pos +3) {
+        char amino = aminoTable[codonKey(&line[pos])];
+        if (amino == 'X') count::incrementCount();
+        translated += amino;
+    }
+
+    return translated;
+}
+
+string translator::translateFrames(string &line, bool stops) {
+    string complement(line.rbegin(), line.rend());    // the reverse complement
+    for (char &base : complement) {
+        switch (base) {
+            case 'A': base = 'T'; break; case 'T': base = 'A'; break;
+            case 'C': base = 'G'; break; case 'G': base = 'C'; break;
+            case 'R': base = 'Y'; break; case 'Y': base = 'R'; break;
+            case 'K': base = 'M'; break; case 'M': base = 'K'; break;
+            case 'B': base = 'V'; break; case 'V': base = 'B'; break;
+            case 'D': base = 'H'; break; case 'H': base = 'D'; break;
+            default: break;    // S, W, N and unknown characters stay
+        }
+    }
+    string translated;
+    translated.reserve(2 * line.length() / 3 + 6);
+    for (string* strand : {&line, &complement}) {
+        for (uint64_t frame = 0; frame < 3; frame++) {
+            for (uint64_t pos = frame; pos+3 <= strand->length(); pos = pos +3) {
+                char amino = aminoTable[codonKey(&(*strand)[pos])];
+                if (amino == 'X') count::incrementCount();
+                translated += stops && amino == '*' ? '.' : amino;
+            }
+            translated += '.';    // the next frame starts a new k-mer
+        }
     }
 
     return translated;
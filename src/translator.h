@@ -17,6 +17,7 @@ using namespace std;
  */
 namespace count {
     extern int getCount();
+    extern void incrementCount();
     extern void deleteCount();
 }
 
@@ -31,6 +32,27 @@ private:
      */
     static struct translationTable translationTable;
 
+    /**
+     * These are the 4-bit masks of the bases each nucleotide (IUPAC) character stands for (A=1, C=2, G=4, T=8; 0 if none).
+     */
+    static uint8_t baseMasks[256];
+
+    /**
+     * This table contains the amino acid for each codon, keyed by the masks of its three bases.
+     * Ambiguous codons are resolved if all their bases translate alike (or to the pairs B, Z, J), others are X.
+     */
+    static char aminoTable[4096];
+
+    /**
+     * This table contains the 5-bit code of the amino acid for each codon, or untranslated if it is not a single amino acid.
+     */
+    static uint8_t codeTable[4096];
+
+    /**
+     * This method fills the lookup tables from the selected genetic code.
+     */
+    static void createTables();
+
     /**
      * This set contains all allowed characters.
      */
@@ -63,11 +85,67 @@ public:
 
     /**
      * This method takes a line of bases and translates them into amino acids by splitting them into triplets first.
+     * Triplets that cannot be translated become X.
      * @param line the line with bases
      * @return the translated line
      */
     static string translate(string& line);
 
+    /**
+     * This method translates a sequence in all six reading frames, the three forward frames followed by the three reverse ones.
+     * The frames are separated by gaps (.), and so are the amino acids of stop codons if requested.
+     * @param line the line with bases
+     * @param stops break at stop codons
+     * @return the translated frames
+     */
+    static string translateFrames(string& line, bool stops);
+
+    /**
+     * This is the code of a codon that is not translated into a single amino acid.
+     */
+    static constexpr uint8_t untranslated = 0xFF;
+
+    /**
+     * This method returns the key of the codon starting at the given position.
+     * @param bases the bases of the codon
+     * @return the masks of its three bases
+     */
+    static inline uint16_t codonKey(const char* bases) {
+        return baseMasks[(uint8_t) bases[0]] << 8 | baseMasks[(uint8_t) bases[1]] << 4 | baseMasks[(uint8_t) bases[2]];
+    }
+
+    /**
+     * This method returns the 5-bit code of the amino acid of a codon.
+     * @param codon the key of the codon
+     * @return the amino acid code or untranslated
+     */
+    static inline uint8_t aminoCode(const uint16_t& codon) {
+        return codeTable[codon];
+    }
+
+    /**
+     * This is the 5-bit code of the amino acid of stop codons (*).
+     */
+    static constexpr uint8_t stopCode = 0b11010u;
+
+    /**
+     * This method returns the mask of the bases a nucleotide character stands for.
+     * @param base the character
+     * @return the 4-bit mask (0 if none)
+     */
+    static inline uint8_t baseMask(const char& base) {
+        return baseMasks[(uint8_t) base];
+    }
+
+    /**
+     * This method returns the mask of the complementary bases.
+     * @param mask the 4-bit mask of a base
+     * @return the 4-bit mask of its complement
+     */
+    static inline uint8_t complementMask(const uint8_t& mask) {
+        return (mask & 1) << 3 | (mask & 2) << 1 | (mask & 4) >> 1 | (mask & 8) >> 3;    // A<->T, C<->G
+    }
+
 protected:
     /**
      * This method initializes the data which is used to verify bases.
@@ -1591,6 +1591,12 @@ public:
         return find_impl(key, hash);
     }
 
+    template<class K>
+    void prefetch(const K& key) const {
+        const std::size_t ibucket = bucket_for_hash(hash_key(key));
+        __builtin_prefetch(m_sparse_buckets + sparse_array::sparse_ibucket(ibucket));
+    }
+
 
     template<class K>
     std::pair<iterator, iterator> equal_range(const K& key) {
@@ -543,6 +543,12 @@ public:
         return m_ht.find(key, precalculated_hash);
     }
 
+    /**
+     * Prefetch the sparse bucket holding the first probe position of `key`, without looking it up.
+     * Useful to hide the cache miss of a later lookup of the same key.
+     */
+    void prefetch(const Key& key) const { m_ht.prefetch(key); }
+
 
 
     bool contains(const Key& key) const { return m_ht.contains(key); }
@@ -93,7 +93,7 @@ void util::check_n(uint64_t& n, string& path, const uint64_t& max_N) {
  * @param y second value
  * @return arithmetic mean
  */
-double util::arithmetic_mean(uint32_t& x, uint32_t& y) {
+double util::arithmetic_mean(uint64_t& x, uint64_t& y) {
     return x / 2.0 + y / 2.0;
 }
 
@@ -104,7 +104,7 @@ double util::arithmetic_mean(uint32_t& x, uint32_t& y) {
  * @param y second value
  * @return geometric mean
  */
-double util::geometric_mean(uint32_t& x, uint32_t& y) {
+double util::geometric_mean(uint64_t& x, uint64_t& y) {
     return sqrt(x) * sqrt(y);
 }
 
@@ -115,7 +115,7 @@ double util::geometric_mean(uint32_t& x, uint32_t& y) {
  * @param y second value
  * @return geometric mean
  */
-double util::geometric_mean2(uint32_t& x, uint32_t& y) {
+double util::geometric_mean2(uint64_t& x, uint64_t& y) {
     return sqrt(x+1) * sqrt(y+1);
 }
 
@@ -384,6 +384,13 @@ bool util::is_number(string& s) {
 
 
 
+uint64_t util::input_size(const string &filename) {
+	ifstream probe(filename, ios::binary | ios::ate);
+	uint64_t bytes = probe.good() ? (uint64_t) probe.tellg() : 0;
+	if (filename.size() > 3 && filename.compare(filename.size()-3, 3, ".gz") == 0) bytes *= 4; // estimated compression ratio
+	return bytes;
+}
+
 bool util::path_exist(const string &filename) {
 	string folder="";
 	uint64_t found=filename.find_last_of("/\\");
@@ -60,7 +60,7 @@ public:
      * @param y second value
      * @return arithmetic mean
      */
-    static double arithmetic_mean(uint32_t& x, uint32_t& y);
+    static double arithmetic_mean(uint64_t& x, uint64_t& y);
 
     /**
      * This function calculates the geometric mean of two values.
@@ -69,7 +69,7 @@ public:
      * @param y second value
      * @return geometric mean
      */
-    static double geometric_mean(uint32_t& x, uint32_t& y);
+    static double geometric_mean(uint64_t& x, uint64_t& y);
 
     /**
      * This function calculates the geometric mean with pseudo counts.
@@ -78,7 +78,7 @@ public:
      * @param y second value
      * @return geometric mean
      */
-    static double geometric_mean2(uint32_t& x, uint32_t& y);
+    static double geometric_mean2(uint64_t& x, uint64_t& y);
 
     /**
      * This function displays a duration in a human readable format.
@@ -168,6 +168,13 @@ public:
      */
 	static bool path_exist(const string &filename);
 
+    /**
+     * Estimates the uncompressed size of a sequence file, gzipped files are assumed to be compressed by a factor of 4.
+     * @param filename the path of the file
+     * @return the estimated number of bytes (0 if the file cannot be read)
+     */
+	static uint64_t input_size(const string &filename);
+
 	
 protected:
 };